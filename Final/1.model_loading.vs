@@ -2,15 +2,31 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per-instance model matrix, used instead of the model uniform when drawing instanced
+layout (location = 7) in mat4 aInstanceMatrix;
 
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// set once per frame and once per draw, through the uniform ring (see uniform_ring.h)
+layout (std140) uniform FrameUniforms
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+};
+layout (std140) uniform DrawUniforms
+{
+    mat4 model;
+    // maps the stored positions back into object space; quantized meshes store them normalized to their bounds
+    vec4 positionOffset;
+    vec4 positionScale;
+    bool instanced;
+};
 
 void main()
 {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    vec3 position = positionOffset.xyz + aPos * positionScale.xyz;
+    mat4 world = instanced ? aInstanceMatrix : model;
+    gl_Position = viewProjection * world * vec4(position, 1.0);
+}
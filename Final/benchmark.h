@@ -0,0 +1,563 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "bvh.h"
+#include "frame_stats.h"
+#include "job_system.h"
+#include "software_occlusion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// a limit on one metric of a benchmark; the run fails if the measured value is higher
+struct BenchmarkBudget {
+    string metric;
+    double limit;
+};
+
+// one scene rendered along one camera path
+struct BenchmarkCase {
+    string name;
+    string scenePath;  // scene description, see scene_description.h
+    string cameraPath; // recorded camera path, see camera_path.h; the scene's orbit if empty
+    unsigned int frames = 300;
+    vector<BenchmarkBudget> budgets;
+};
+
+// a benchmark suite file lists the scenes to run, one statement per line, '#' starts a comment:
+//   size <width>x<height>                 render target size for all benchmarks
+//   warmup <n>                            frames rendered before measuring starts (shader and texture warm-up)
+//   frames <n>                            measured frames of the benchmarks that follow
+//   benchmark <name> <scene file>         adds a benchmark
+//   camera <path file>                    replays a recorded camera path in the last benchmark
+//   budget <metric> <limit>               fails the last benchmark if the metric is above the limit
+struct BenchmarkSuite {
+    unsigned int width = 1280;
+    unsigned int height = 720;
+    unsigned int warmupFrames = 10;
+    vector<BenchmarkCase> cases;
+};
+
+// the measurements of one benchmark. Draw calls, state changes, uniform blocks, triangles and the culling and level of
+// detail counts are averages per measured frame.
+struct BenchmarkResult {
+    string name;
+    double loadMilliseconds = 0.0;
+    bool loadedFromCache = true; // every model came from the mesh cache
+    FrameStatistics frames;
+    double drawCalls = 0.0;
+    double drawnMeshes = 0.0;
+    double stateChanges = 0.0;
+    double skippedStateChanges = 0.0;
+    double triangles = 0.0;
+    double submittedObjects = 0.0;
+    double culledObjects = 0.0;
+    double occludedObjects = 0.0;
+    double simplifiedObjects = 0.0;
+    double uniformBlocks = 0.0;
+    double allocationsPerFrame = 0.0; // heap allocations, on any thread; the render loop should make none
+    size_t objects = 0;
+    size_t models = 0;
+    size_t vertexBytes = 0;
+    size_t indexBytes = 0;
+    size_t textures = 0;
+
+    // the metrics budgets can refer to
+    static const vector<string>& MetricNames()
+    {
+        static const vector<string> names = { "load_ms", "mean_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms", "draw_calls",
+                                              "state_changes", "skipped_state_changes", "triangles", "submitted_objects", "culled_objects",
+                                              "occluded_objects", "simplified_objects", "uniform_blocks", "allocations_per_frame", "vertex_bytes", "index_bytes", "textures" };
+        return names;
+    }
+
+    double Metric(const string& name) const
+    {
+        if (name == "load_ms") return loadMilliseconds;
+        if (name == "mean_ms") return frames.mean;
+        if (name == "p50_ms") return frames.p50;
+        if (name == "p95_ms") return frames.p95;
+        if (name == "p99_ms") return frames.p99;
+        if (name == "max_ms") return frames.max;
+        if (name == "draw_calls") return drawCalls;
+        if (name == "state_changes") return stateChanges;
+        if (name == "skipped_state_changes") return skippedStateChanges;
+        if (name == "triangles") return triangles;
+        if (name == "submitted_objects") return submittedObjects;
+        if (name == "culled_objects") return culledObjects;
+        if (name == "occluded_objects") return occludedObjects;
+        if (name == "simplified_objects") return simplifiedObjects;
+        if (name == "uniform_blocks") return uniformBlocks;
+        if (name == "allocations_per_frame") return allocationsPerFrame;
+        if (name == "vertex_bytes") return static_cast<double>(vertexBytes);
+        if (name == "index_bytes") return static_cast<double>(indexBytes);
+        if (name == "textures") return static_cast<double>(textures);
+        return 0.0;
+    }
+};
+
+// reads a benchmark suite file; returns false and reports the offending line if it can't be parsed
+inline bool LoadBenchmarkSuite(const string& path, BenchmarkSuite& suite)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cout << "ERROR::BENCHMARK::FILE_NOT_SUCCESSFULLY_READ: " << path << endl;
+        return false;
+    }
+
+    suite = BenchmarkSuite();
+    unsigned int frames = 300;
+    string line;
+    for (unsigned int lineNumber = 1; getline(file, line); lineNumber++)
+    {
+        size_t comment = line.find('#');
+        if (comment != string::npos)
+            line.erase(comment);
+        istringstream statement(line);
+        string keyword;
+        if (!(statement >> keyword))
+            continue;
+
+        bool valid = false;
+        if (keyword == "size")
+        {
+            string size;
+            char separator = 0;
+            valid = static_cast<bool>(statement >> size);
+            istringstream dimensions(size);
+            valid = valid && dimensions >> suite.width >> separator >> suite.height && separator == 'x' && suite.width > 0 && suite.height > 0;
+        }
+        else if (keyword == "warmup")
+            valid = static_cast<bool>(statement >> suite.warmupFrames);
+        else if (keyword == "frames")
+            valid = statement >> frames && frames > 0;
+        else if (keyword == "benchmark")
+        {
+            BenchmarkCase benchmark;
+            benchmark.frames = frames;
+            valid = static_cast<bool>(statement >> benchmark.name >> benchmark.scenePath);
+            if (valid)
+                suite.cases.push_back(benchmark);
+        }
+        else if (keyword == "camera")
+            valid = !suite.cases.empty() && statement >> suite.cases.back().cameraPath;
+        else if (keyword == "budget")
+        {
+            BenchmarkBudget budget;
+            const vector<string>& names = BenchmarkResult::MetricNames();
+            valid = !suite.cases.empty() && statement >> budget.metric >> budget.limit
+                    && std::find(names.begin(), names.end(), budget.metric) != names.end();
+            if (valid)
+                suite.cases.back().budgets.push_back(budget);
+        }
+        string trailing;
+        if (!valid || statement >> trailing)
+        {
+            cout << "ERROR::BENCHMARK::INVALID_STATEMENT " << path << ":" << lineNumber << ": " << line << endl;
+            return false;
+        }
+    }
+    if (suite.cases.empty())
+    {
+        cout << "ERROR::BENCHMARK::NO_BENCHMARKS " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+// writes a JSON report to the file, or to standard output if no file is given; false if the file can't be written
+inline bool EmitJson(const string& jsonPath, const string& text)
+{
+    if (jsonPath.empty())
+    {
+        cout << text;
+        return true;
+    }
+    ofstream file(jsonPath);
+    file << text;
+    if (!file)
+    {
+        cout << "ERROR::BENCHMARK::CANNOT_WRITE " << jsonPath << endl;
+        return false;
+    }
+    return true;
+}
+
+// writes the results as JSON, to the file or to standard output if no file is given
+inline bool WriteBenchmarkJson(const string& path, const BenchmarkSuite& suite, const vector<BenchmarkResult>& results)
+{
+    ostringstream json;
+    json << "{\n  \"width\": " << suite.width << ",\n  \"height\": " << suite.height << ",\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& result = results[i];
+        json << (i ? "," : "") << "\n    {\n"
+             << "      \"name\": \"" << result.name << "\",\n"
+             << "      \"frames\": " << result.frames.frames << ",\n"
+             << "      \"loaded_from_cache\": " << (result.loadedFromCache ? "true" : "false") << ",\n"
+             << "      \"objects\": " << result.objects << ",\n"
+             << "      \"models\": " << result.models << ",\n"
+             << "      \"drawn_meshes\": " << result.drawnMeshes;
+        for (const string& metric : BenchmarkResult::MetricNames())
+            json << ",\n      \"" << metric << "\": " << result.Metric(metric);
+        json << "\n    }";
+    }
+    json << "\n  ]\n}\n";
+
+    return EmitJson(path, json.str());
+}
+
+// reports every budget a benchmark exceeded; returns whether all of them held
+inline bool CheckBenchmarkBudgets(const BenchmarkSuite& suite, const vector<BenchmarkResult>& results)
+{
+    bool withinBudget = true;
+    for (size_t i = 0; i < suite.cases.size() && i < results.size(); i++)
+        for (const BenchmarkBudget& budget : suite.cases[i].budgets)
+        {
+            double value = results[i].Metric(budget.metric);
+            if (value > budget.limit)
+            {
+                cout << "BENCHMARK::BUDGET_EXCEEDED " << results[i].name << " " << budget.metric << " " << value
+                     << " > " << budget.limit << endl;
+                withinBudget = false;
+            }
+        }
+    return withinBudget;
+}
+
+// the report of a benchmark that measures the same things over several inputs (sizes, thread counts): a few fields
+// describing the run, then an array with a record of named measurements per input. Written like WriteBenchmarkJson.
+class BenchmarkReport
+{
+public:
+    explicit BenchmarkReport(const string& recordsName) : recordsName(recordsName) {}
+
+    // a field describing the whole run, before the records
+    template <typename T>
+    void Field(const string& name, const T& value)
+    {
+        fields.push_back({ name, jsonValue(value) });
+    }
+
+    // starts the next record; Set adds measurements to it
+    void Record()
+    {
+        records.emplace_back();
+    }
+
+    template <typename T>
+    void Set(const string& name, const T& value)
+    {
+        records.back().push_back({ name, jsonValue(value) });
+    }
+
+    // writes the report to the file, or to standard output if no file is given; 0 on success, -1 otherwise
+    int Emit(const string& jsonPath) const
+    {
+        ostringstream json;
+        json << "{";
+        for (const pair<string, string>& field : fields)
+            json << "\n  \"" << field.first << "\": " << field.second << ",";
+        json << "\n  \"" << recordsName << "\": [";
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            json << (i ? "," : "") << "\n    {";
+            for (size_t j = 0; j < records[i].size(); j++)
+                json << (j ? "," : "") << "\n      \"" << records[i][j].first << "\": " << records[i][j].second;
+            json << "\n    }";
+        }
+        json << "\n  ]\n}\n";
+        return EmitJson(jsonPath, json.str()) ? 0 : -1;
+    }
+
+private:
+    string recordsName;
+    vector<pair<string, string>> fields;
+    vector<vector<pair<string, string>>> records;
+
+    template <typename T>
+    static string jsonValue(const T& value)
+    {
+        ostringstream text;
+        text << value;
+        return text.str();
+    }
+
+    static string jsonValue(const string& text)
+    {
+        return "\"" + text + "\"";
+    }
+
+    static string jsonValue(const char* text)
+    {
+        return jsonValue(string(text));
+    }
+};
+
+// calls body(i) for i from 0 to count and returns the average time of a call in milliseconds
+template <typename Body>
+inline double AverageMilliseconds(unsigned int count, const Body& body)
+{
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < count; i++)
+        body(i);
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / count;
+}
+
+// the thread counts to measure scaling with: 1, 2, 4... up to one per core
+inline vector<unsigned int> BenchmarkThreadCounts()
+{
+    vector<unsigned int> threadCounts;
+    unsigned int cores = std::max(thread::hardware_concurrency(), 1u);
+    for (unsigned int threads = 1; threads < cores; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(cores);
+    return threadCounts;
+}
+
+// the scene hierarchy on its own, without a GL context: builds a BVH over n random boxes (spread out like the
+// forest scenes, a few units apart), moves every box a little and refits it, culls against a camera turning
+// around in the middle, comparing with testing every box, and casts random rays. Reports the times as JSON like
+// WriteBenchmarkJson does.
+inline int RunBvhBenchmark(const string& jsonPath)
+{
+    const unsigned int repeats = 5, views = 64, rays = 10000;
+
+    BenchmarkReport report("bvh");
+    const size_t sizes[] = { 10000, 30000, 100000 };
+    for (size_t n : sizes)
+    {
+        mt19937 random(12345);
+        float side = 4.0f * cbrt(static_cast<float>(n));
+        uniform_real_distribution<float> position(-0.5f * side, 0.5f * side), extent(0.5f, 1.5f), jitter(-0.1f, 0.1f);
+        vector<AABB> boxes(n);
+        for (AABB& box : boxes)
+        {
+            glm::vec3 center(position(random), position(random), position(random));
+            glm::vec3 extents(extent(random), extent(random), extent(random));
+            box.min = center - extents;
+            box.max = center + extents;
+        }
+
+        BVH bvh;
+        double buildMs = AverageMilliseconds(repeats, [&](unsigned int) { bvh.Build(boxes); });
+
+        vector<AABB> moved = boxes;
+        for (AABB& box : moved)
+        {
+            glm::vec3 offset(jitter(random), jitter(random), jitter(random));
+            box.min += offset;
+            box.max += offset;
+        }
+        double refitMs = AverageMilliseconds(repeats, [&](unsigned int i) {
+            const vector<AABB>& source = i % 2 ? boxes : moved;
+            for (uint32_t primitive = 0; primitive < n; primitive++)
+                bvh.Update(primitive, source[primitive]);
+            bvh.Refit();
+        });
+        bvh.Build(boxes);
+
+        BoxArray flatBoxes;
+        flatBoxes.Resize(n);
+        for (size_t i = 0; i < n; i++)
+            flatBoxes.Set(i, boxes[i]);
+        vector<Frustum> frustums(views);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+        for (unsigned int i = 0; i < views; i++)
+        {
+            float angle = glm::radians(360.0f * i / views);
+            glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(cos(angle), 0.2f, sin(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+            frustums[i] = Frustum::FromMatrix(projection * view);
+        }
+        size_t visible = 0, flatVisible = 0;
+        double cullMs = AverageMilliseconds(views, [&](unsigned int i) { visible += bvh.Cull(frustums[i], [](uint32_t) {}); });
+        double flatCullMs = AverageMilliseconds(views, [&](unsigned int i) { flatVisible += CullBoxes(frustums[i], flatBoxes, 0, n, [](size_t) {}); });
+
+        uniform_real_distribution<float> direction(-1.0f, 1.0f);
+        vector<glm::vec3> origins(rays), directions(rays);
+        for (unsigned int i = 0; i < rays; i++)
+        {
+            origins[i] = glm::vec3(position(random), position(random), position(random));
+            directions[i] = glm::normalize(glm::vec3(direction(random), direction(random), direction(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+        }
+        size_t hits = 0;
+        double rayUs = 1000.0 * AverageMilliseconds(rays, [&](unsigned int i) {
+            float distance = 100.0f;
+            uint32_t primitive;
+            hits += bvh.Raycast(origins[i], directions[i], distance, primitive);
+        });
+
+        cout << "BVH::BENCHMARK " << n << " boxes: " << bvh.nodes.size() << " nodes, depth " << bvh.depth << ", build "
+             << buildMs << " ms, refit " << refitMs << " ms, cull " << cullMs << " ms (every box: " << flatCullMs
+             << " ms), ray " << rayUs << " us" << endl;
+        if (visible != flatVisible)
+            cout << "WARNING::BVH::BENCHMARK culling found " << visible << " boxes, testing every box " << flatVisible << endl;
+
+        report.Record();
+        report.Set("boxes", n);
+        report.Set("nodes", bvh.nodes.size());
+        report.Set("depth", bvh.depth);
+        report.Set("build_ms", buildMs);
+        report.Set("refit_ms", refitMs);
+        report.Set("cull_ms", cullMs);
+        report.Set("flat_cull_ms", flatCullMs);
+        report.Set("visible", (double)visible / views);
+        report.Set("ray_us", rayUs);
+        report.Set("ray_hit_rate", (double)hits / rays);
+    }
+    return report.Emit(jsonPath);
+}
+
+// a closed unit sphere of segments around and rings from pole to pole, two triangles per quad
+inline OccluderProxy SphereOccluderProxy(unsigned int segments, unsigned int rings)
+{
+    OccluderProxy proxy;
+    for (unsigned int ring = 0; ring <= rings; ring++)
+        for (unsigned int segment = 0; segment <= segments; segment++)
+        {
+            float theta = glm::pi<float>() * ring / rings, phi = 2.0f * glm::pi<float>() * segment / segments;
+            proxy.positions.push_back(glm::vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)));
+        }
+    for (unsigned int ring = 0; ring < rings; ring++)
+        for (unsigned int segment = 0; segment < segments; segment++)
+        {
+            uint32_t corner = ring * (segments + 1) + segment, below = corner + segments + 1;
+            proxy.indices.insert(proxy.indices.end(), { corner, below, corner + 1, corner + 1, below, below + 1 });
+        }
+    return proxy;
+}
+
+// the software occlusion rasterizer on its own, without a GL context: renders spheres as detailed as an occluder
+// proxy gets, scattered in front of the camera, on 1, 2, 4... threads up to one per core, and tests random boxes
+// behind them against the result. Reports triangles per second, in all and per thread, and the time per box as
+// JSON like WriteBenchmarkJson does.
+inline int RunOcclusionBenchmark(const string& jsonPath)
+{
+    const unsigned int repeats = 50, boxCount = 10000, occluderCount = 32;
+
+    OccluderProxy sphere = SphereOccluderProxy(32, 32);
+    mt19937 random(12345);
+    uniform_real_distribution<float> across(-1.0f, 1.0f), nearDistance(5.0f, 40.0f), farDistance(40.0f, 90.0f), radius(0.5f, 3.0f), extent(0.5f, 1.5f);
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f); // looking down -z
+    vector<OccluderDraw> occluders(occluderCount);
+    for (OccluderDraw& occluder : occluders)
+    {
+        float distance = nearDistance(random);
+        glm::vec3 position(across(random) * 0.6f * distance, across(random) * 0.35f * distance, -distance);
+        occluder.proxy = &sphere;
+        occluder.transform = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(radius(random)));
+    }
+    vector<AABB> boxes(boxCount);
+    for (AABB& box : boxes)
+    {
+        float distance = farDistance(random);
+        glm::vec3 center(across(random) * 0.6f * distance, across(random) * 0.35f * distance, -distance);
+        glm::vec3 extents(extent(random));
+        box.min = center - extents;
+        box.max = center + extents;
+    }
+
+    BenchmarkReport report("occlusion");
+    report.Field("simd", OCCLUSION_SIMD_NAME);
+    report.Field("width", SOFTWARE_OCCLUSION_WIDTH);
+    report.Field("height", SOFTWARE_OCCLUSION_HEIGHT);
+    for (unsigned int threads : BenchmarkThreadCounts())
+    {
+        JobSystem jobs(threads);
+        SoftwareOcclusion occlusion(jobs);
+        occlusion.Render(occluders, viewProjection);
+        double renderMs = AverageMilliseconds(repeats, [&](unsigned int) { occlusion.Render(occluders, viewProjection); });
+        size_t triangles = occlusion.RasterizedTriangles();
+        double trianglesPerSecond = triangles / (renderMs / 1000.0);
+        double perThread = trianglesPerSecond / occlusion.Threads();
+
+        size_t occluded = 0;
+        double boxNs = 1e6 * AverageMilliseconds(boxCount, [&](unsigned int box) { occluded += occlusion.Occluded(boxes[box]); });
+
+        cout << "OCCLUSION::BENCHMARK " << occlusion.Threads() << " threads (" << OCCLUSION_SIMD_NAME << "): " << triangles
+             << " triangles in " << renderMs << " ms, " << trianglesPerSecond / 1e6 << " M triangles/s (" << perThread / 1e6
+             << " M per thread), box test " << boxNs << " ns, " << occluded << " of " << boxCount << " boxes occluded" << endl;
+        report.Record();
+        report.Set("threads", occlusion.Threads());
+        report.Set("triangles", triangles);
+        report.Set("render_ms", renderMs);
+        report.Set("triangles_per_second", trianglesPerSecond);
+        report.Set("triangles_per_second_per_thread", perThread);
+        report.Set("box_test_ns", boxNs);
+        report.Set("occluded_boxes", occluded);
+    }
+    return report.Emit(jsonPath);
+}
+
+// the JobSystem on 1, 2, 4... threads up to one per core, without a GL context: transforms a million boxes (the
+// per object work of Scene) in a ParallelFor, and submits batches of empty jobs to measure what scheduling alone
+// costs. Reports the throughput of both and the speedup over one thread as JSON like WriteBenchmarkJson does.
+inline int RunJobBenchmark(const string& jsonPath)
+{
+    const unsigned int repeats = 10, batches = 200;
+    const size_t boxCount = 1000000, batchSize = 1024;
+
+    mt19937 random(12345);
+    uniform_real_distribution<float> position(-100.0f, 100.0f), angle(0.0f, 6.2831853f), extent(0.5f, 1.5f);
+    vector<AABB> boxes(boxCount), transformed(boxCount);
+    vector<glm::mat4> transforms(boxCount);
+    for (size_t i = 0; i < boxCount; i++)
+    {
+        glm::vec3 center(position(random), position(random), position(random));
+        boxes[i].min = center - glm::vec3(extent(random));
+        boxes[i].max = center + glm::vec3(extent(random));
+        transforms[i] = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(position(random))), angle(random), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    BenchmarkReport report("jobs");
+    double singleThreadMs = 0.0;
+    for (unsigned int threads : BenchmarkThreadCounts())
+    {
+        JobSystem jobs(threads);
+        auto transformAll = [&](size_t begin, size_t end) {
+            for (size_t box = begin; box < end; box++)
+                transformed[box] = boxes[box].Transformed(transforms[box]);
+        };
+        jobs.ParallelFor(boxCount, 1024, transformAll);
+        double transformMs = AverageMilliseconds(repeats, [&](unsigned int) { jobs.ParallelFor(boxCount, 1024, transformAll); });
+        if (threads == 1)
+            singleThreadMs = transformMs;
+        double speedup = singleThreadMs / transformMs;
+
+        vector<Job> batch(batchSize);
+        for (Job& job : batch)
+            job.run = [](const Job&) {};
+        JobCounter counter;
+        double batchMs = AverageMilliseconds(batches, [&](unsigned int) {
+            jobs.Submit(batch.data(), batch.size(), counter);
+            jobs.Wait(counter);
+        });
+        double jobsPerSecond = batchSize / (batchMs / 1000.0);
+
+        cout << "JOBS::BENCHMARK " << jobs.Threads() << " threads: transform " << boxCount << " boxes in " << transformMs << " ms ("
+             << boxCount / (transformMs / 1000.0) / 1e6 << " M boxes/s, " << speedup << "x one thread, " << speedup / jobs.Threads() * 100.0
+             << "% efficiency), " << jobsPerSecond / 1e6 << " M empty jobs/s" << endl;
+        report.Record();
+        report.Set("threads", jobs.Threads());
+        report.Set("transform_ms", transformMs);
+        report.Set("boxes_per_second", boxCount / (transformMs / 1000.0));
+        report.Set("speedup", speedup);
+        report.Set("efficiency", speedup / jobs.Threads());
+        report.Set("empty_jobs_per_second", jobsPerSecond);
+    }
+    return report.Emit(jsonPath);
+}
+#endif
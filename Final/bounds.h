@@ -0,0 +1,283 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BOUNDS_SSE 1
+#include <xmmintrin.h>
+#else
+#define BOUNDS_SSE 0
+#endif
+
+// axis-aligned bounding box. A default constructed box is empty: extending it with anything gives that thing.
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool Empty() const
+    {
+        return min.x > max.x;
+    }
+
+    void Extend(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Extend(const AABB& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 Center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 Extents() const
+    {
+        return (max - min) * 0.5f;
+    }
+
+    float SurfaceArea() const
+    {
+        if (Empty())
+            return 0.0f;
+        glm::vec3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // the box around this box after transforming it (Arvo, "Transforming Axis-Aligned Bounding Boxes")
+    AABB Transformed(const glm::mat4& transform) const
+    {
+        if (Empty())
+            return *this;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+        glm::vec3 extents = Extents();
+        glm::vec3 newExtents(0.0f);
+        for (int column = 0; column < 3; column++)
+            newExtents += glm::abs(glm::vec3(transform[column])) * extents[column];
+        AABB box;
+        box.min = center - newExtents;
+        box.max = center + newExtents;
+        return box;
+    }
+};
+
+// whether the ray origin + t * direction hits the box for some t in [0, maxDistance] (slab test); sets distance to
+// the first such t. Takes 1 / direction, which callers testing many boxes compute once.
+inline bool RayIntersectsBox(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& distance)
+{
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+    distance = enter;
+    return enter <= exit;
+}
+
+// how much a transform stretches lengths at most: the longest of its axes
+inline float MaxScale(const glm::mat4& transform)
+{
+    return std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+}
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = -1.0f; // negative for an empty sphere
+
+    // the sphere around this sphere after transforming it; non-uniform scale grows it to the largest axis
+    BoundingSphere Transformed(const glm::mat4& transform) const
+    {
+        BoundingSphere sphere;
+        sphere.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+        sphere.radius = radius * MaxScale(transform);
+        return sphere;
+    }
+};
+
+// the bounds of a set of points: their box, and a sphere around the box center just big enough to hold them
+// (usually much tighter than the box's own circumsphere)
+template <typename PointOf>
+inline void ComputeBounds(size_t count, PointOf pointOf, AABB& box, BoundingSphere& sphere)
+{
+    box = AABB();
+    for (size_t i = 0; i < count; i++)
+        box.Extend(pointOf(i));
+    sphere = BoundingSphere();
+    if (box.Empty())
+        return;
+    sphere.center = box.Center();
+    float radiusSquared = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 offset = pointOf(i) - sphere.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    sphere.radius = std::sqrt(radiusSquared);
+}
+
+// the six planes of a view frustum, pointing inwards: a point p is inside plane n if dot(n.xyz, p) + n.w >= 0
+struct Frustum {
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    enum Containment { OUTSIDE, INTERSECTING, INSIDE };
+    static const unsigned int ALL_PLANES = 0x3f;
+
+    // extracts the planes from a projection * view (* model) matrix (Gribb and Hartmann), in the space that
+    // matrix transforms from
+    static Frustum FromMatrix(const glm::mat4& m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0;
+        frustum.planes[1] = row3 - row0;
+        frustum.planes[2] = row3 + row1;
+        frustum.planes[3] = row3 - row1;
+        frustum.planes[4] = row3 + row2;
+        frustum.planes[5] = row3 - row2;
+        for (glm::vec4& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    bool Intersects(const BoundingSphere& sphere) const
+    {
+        for (const glm::vec4& plane : planes)
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        return true;
+    }
+
+    // conservative: a box near a frustum corner may pass although it's outside
+    bool Intersects(const AABB& box) const
+    {
+        unsigned int planeMask = ALL_PLANES;
+        return Classify(box, planeMask) != OUTSIDE;
+    }
+
+    // where a box is relative to the frustum, testing only the planes in planeMask (bit i for planes[i]).
+    // Planes the box lies fully inside of are removed from the mask, so the boxes within it, e.g. the children
+    // of a hierarchy node, don't need to test them again.
+    Containment Classify(const AABB& box, unsigned int& planeMask) const
+    {
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        for (int p = 0; p < 6; p++)
+        {
+            if (!(planeMask >> p & 1))
+                continue;
+            const glm::vec4& plane = planes[p];
+            float radius = glm::dot(extents, glm::abs(glm::vec3(plane)));
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            if (distance < -radius)
+                return OUTSIDE;
+            if (distance >= radius)
+                planeMask &= ~(1u << p);
+        }
+        return planeMask ? INTERSECTING : INSIDE;
+    }
+};
+
+// boxes stored as separate center and extent arrays, so a culling pass tests four of them at a time
+struct BoxArray {
+    vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+
+    size_t Size() const
+    {
+        return centerX.size();
+    }
+
+    void Resize(size_t size)
+    {
+        for (vector<float>* array : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+            array->resize(size);
+    }
+
+    void Set(size_t index, const AABB& box)
+    {
+        glm::vec3 center = box.Center(), extents = box.Extents();
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        extentX[index] = extents.x;
+        extentY[index] = extents.y;
+        extentZ[index] = extents.z;
+    }
+};
+
+// tests boxes [first, first + count) against the frustum and calls visit(i) for each one inside it (in order).
+// Returns how many are visible. Conservative in the same way as Frustum::Intersects.
+template <typename Visit>
+inline size_t CullBoxes(const Frustum& frustum, const BoxArray& boxes, size_t first, size_t count, Visit visit)
+{
+    size_t visibleCount = 0;
+    size_t i = first, end = first + count;
+#if BOUNDS_SSE
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    for (int p = 0; p < 6; p++)
+    {
+        const glm::vec4& plane = frustum.planes[p];
+        planeX[p] = _mm_set1_ps(plane.x);
+        planeY[p] = _mm_set1_ps(plane.y);
+        planeZ[p] = _mm_set1_ps(plane.z);
+        planeW[p] = _mm_set1_ps(plane.w);
+        absX[p] = _mm_set1_ps(std::fabs(plane.x));
+        absY[p] = _mm_set1_ps(std::fabs(plane.y));
+        absZ[p] = _mm_set1_ps(std::fabs(plane.z));
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&boxes.centerX[i]);
+        __m128 y = _mm_loadu_ps(&boxes.centerY[i]);
+        __m128 z = _mm_loadu_ps(&boxes.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+                                         _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_sub_ps(zero, radius)));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++)
+            if (!(mask >> k & 1))
+            {
+                visit(i + k);
+                visibleCount++;
+            }
+    }
+#endif
+    for (; i < end; i++)
+    {
+        AABB box;
+        glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+        glm::vec3 extents(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+        box.min = center - extents;
+        box.max = center + extents;
+        if (frustum.Intersects(box))
+        {
+            visit(i);
+            visibleCount++;
+        }
+    }
+    return visibleCount;
+}
+#endif
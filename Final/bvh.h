@@ -0,0 +1,354 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// a bounding volume hierarchy over a set of boxes (its primitives), so culling and ray queries only look at the
+// parts of the set they can touch. It is built top down with the surface area heuristic over binned centroids and
+// flattened into one array of 32 byte nodes: the two children of a node are next to each other, and the primitives
+// below any node are consecutive in tree order. When boxes move, Refit updates the node bounds and keeps the tree.
+class BVH
+{
+public:
+    struct Node {
+        glm::vec3 min;
+        uint32_t leftFirst; // inner nodes: the left child, the right one follows it; leaves: the first primitive
+        glm::vec3 max;
+        uint32_t count;     // the primitives of a leaf; 0 for inner nodes
+
+        bool Leaf() const
+        {
+            return count > 0;
+        }
+
+        AABB Bounds() const
+        {
+            AABB box;
+            box.min = min;
+            box.max = max;
+            return box;
+        }
+    };
+
+    static const unsigned int BINS = 12;          // split candidates per axis are the borders between bins
+    static const uint32_t MAX_LEAF_SIZE = 8;      // leaves are split even where the heuristic says not to
+    static const unsigned int MAX_DEPTH = 48;     // and never split below this, which bounds the traversal stack
+    static constexpr float TRAVERSAL_COST = 4.0f; // of visiting a node, relative to testing one primitive: leaves are
+                                                  // tested four boxes at a time, so a few boxes per leaf are cheap
+
+    vector<Node> nodes;          // nodes[0] is the root
+    vector<uint32_t> primitives; // the primitive indices in tree order
+    unsigned int depth = 0;      // of the deepest leaf
+
+    size_t Size() const
+    {
+        return boxes.size();
+    }
+
+    // builds the tree over boxes; primitive i is boxes[i]
+    void Build(const vector<AABB>& primitiveBoxes)
+    {
+        boxes = primitiveBoxes;
+        uint32_t count = static_cast<uint32_t>(boxes.size());
+        centroids.resize(count);
+        primitives.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            centroids[i] = boxes[i].Center();
+            primitives[i] = i;
+        }
+
+        nodes.clear();
+        depth = 0;
+        if (count == 0)
+            return;
+        // a binary tree with at most one primitive per leaf has 2n - 1 nodes, so the nodes never move while building
+        nodes.reserve(2 * count - 1);
+        nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), count });
+        updateBounds(0);
+        subdivide(0, 0);
+        nodes.shrink_to_fit();
+
+        slotOf.resize(count);
+        leafBoxes.Resize(count);
+        for (uint32_t slot = 0; slot < count; slot++)
+        {
+            slotOf[primitives[slot]] = slot;
+            leafBoxes.Set(slot, boxes[primitives[slot]]);
+        }
+    }
+
+    // moves one primitive; the nodes above it only follow with the next Refit
+    void Update(uint32_t primitive, const AABB& box)
+    {
+        boxes[primitive] = box;
+        leafBoxes.Set(slotOf[primitive], box);
+    }
+
+    // recomputes every node's bounds bottom up from the primitive boxes. The tree stays as it was built, so it gets
+    // looser the further the primitives move from where they were; rebuild once they have moved a lot.
+    void Refit()
+    {
+        // children always come after their parent, so walking backwards sees them first
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            Node& node = nodes[i];
+            if (node.Leaf())
+                updateBounds(static_cast<uint32_t>(i));
+            else
+            {
+                const Node& left = nodes[node.leftFirst];
+                const Node& right = nodes[node.leftFirst + 1];
+                node.min = glm::min(left.min, right.min);
+                node.max = glm::max(left.max, right.max);
+            }
+        }
+    }
+
+    // calls visit(primitive) for every primitive whose box intersects the frustum; returns how many that were.
+    // Subtrees entirely inside or outside the frustum are accepted or rejected as a whole, and a node inside some
+    // of the planes doesn't pass them down to its children. Leaves test their boxes four at a time.
+    template <typename Visit>
+    size_t Cull(const Frustum& frustum, Visit visit) const
+    {
+        if (nodes.empty())
+            return 0;
+        struct Entry {
+            uint32_t node;
+            unsigned int planeMask;
+        };
+        Entry stack[MAX_DEPTH + 2];
+        size_t stackSize = 0;
+        stack[stackSize++] = { 0, Frustum::ALL_PLANES };
+        size_t visibleCount = 0;
+        while (stackSize)
+        {
+            Entry entry = stack[--stackSize];
+            const Node& node = nodes[entry.node];
+            unsigned int planeMask = entry.planeMask;
+            if (planeMask && frustum.Classify(node.Bounds(), planeMask) == Frustum::OUTSIDE)
+                continue;
+            if (!node.Leaf())
+            {
+                stack[stackSize++] = { node.leftFirst + 1, planeMask };
+                stack[stackSize++] = { node.leftFirst, planeMask };
+            }
+            else if (!planeMask)
+            {
+                for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.count; slot++)
+                    visit(primitives[slot]);
+                visibleCount += node.count;
+            }
+            else
+                visibleCount += CullBoxes(frustum, leafBoxes, node.leftFirst, node.count, [&](size_t slot) { visit(primitives[slot]); });
+        }
+        return visibleCount;
+    }
+
+    // finds the nearest primitive along the ray origin + t * direction with t in [0, distance]. hit(primitive,
+    // maxDistance) is asked for every primitive whose box the ray passes through, and returns where the ray hits
+    // the primitive itself, or a negative value if it misses it. On a hit, sets primitive and distance.
+    template <typename Hit>
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, uint32_t& primitive, Hit hit) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverseDirection = 1.0f / direction;
+        bool found = false;
+        float nearest = distance;
+        float entry;
+        if (!RayIntersectsBox(nodes[0].Bounds(), origin, inverseDirection, nearest, entry))
+            return false;
+        struct Entry {
+            uint32_t node;
+            float distance; // where the ray enters the node
+        };
+        Entry stack[MAX_DEPTH + 2];
+        size_t stackSize = 0;
+        stack[stackSize++] = { 0, entry };
+        while (stackSize)
+        {
+            Entry current = stack[--stackSize];
+            if (current.distance > nearest)
+                continue;
+            const Node& node = nodes[current.node];
+            if (node.Leaf())
+            {
+                for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.count; slot++)
+                {
+                    float boxDistance;
+                    if (!RayIntersectsBox(boxes[primitives[slot]], origin, inverseDirection, nearest, boxDistance))
+                        continue;
+                    float hitDistance = hit(primitives[slot], nearest);
+                    if (hitDistance >= 0.0f && hitDistance <= nearest)
+                    {
+                        nearest = hitDistance;
+                        primitive = primitives[slot];
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            // visit the nearer child first, so the farther one can often be skipped
+            float leftDistance, rightDistance;
+            bool left = RayIntersectsBox(nodes[node.leftFirst].Bounds(), origin, inverseDirection, nearest, leftDistance);
+            bool right = RayIntersectsBox(nodes[node.leftFirst + 1].Bounds(), origin, inverseDirection, nearest, rightDistance);
+            Entry leftEntry = { node.leftFirst, leftDistance }, rightEntry = { node.leftFirst + 1, rightDistance };
+            if (left && right)
+            {
+                if (leftDistance > rightDistance)
+                    std::swap(leftEntry, rightEntry);
+                stack[stackSize++] = rightEntry;
+                stack[stackSize++] = leftEntry;
+            }
+            else if (left)
+                stack[stackSize++] = leftEntry;
+            else if (right)
+                stack[stackSize++] = rightEntry;
+        }
+        if (found)
+            distance = nearest;
+        return found;
+    }
+
+    // the nearest primitive box along the ray
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, uint32_t& primitive) const
+    {
+        glm::vec3 inverseDirection = 1.0f / direction;
+        return Raycast(origin, direction, distance, primitive, [&](uint32_t hitPrimitive, float maxDistance) {
+            float boxDistance;
+            return RayIntersectsBox(boxes[hitPrimitive], origin, inverseDirection, maxDistance, boxDistance) ? boxDistance : -1.0f;
+        });
+    }
+
+private:
+    vector<AABB> boxes;          // of the primitives, by primitive index
+    vector<glm::vec3> centroids; // only used while building
+    vector<uint32_t> slotOf;     // where each primitive is in tree order
+    BoxArray leafBoxes;          // the primitive boxes in tree order, for the leaf tests
+
+    // the node's bounds from the boxes of its primitives; leaves only
+    void updateBounds(uint32_t nodeIndex)
+    {
+        Node& node = nodes[nodeIndex];
+        AABB box;
+        for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.count; slot++)
+            box.Extend(boxes[primitives[slot]]);
+        node.min = box.min;
+        node.max = box.max;
+    }
+
+    struct Bin {
+        AABB bounds;
+        uint32_t count = 0;
+    };
+
+    // the cheapest split of the node's primitives by the surface area heuristic: the axis, and the bin its right
+    // half starts at. Returns its cost, or FLT_MAX if the centroids can't be told apart on any axis.
+    float findSplit(const Node& node, const AABB& centroidBounds, int& bestAxis, unsigned int& bestBin) const
+    {
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float minimum = centroidBounds.min[axis], extent = centroidBounds.max[axis] - minimum;
+            if (extent <= 0.0f)
+                continue;
+            Bin bins[BINS];
+            float scale = BINS / extent;
+            for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.count; slot++)
+            {
+                uint32_t primitive = primitives[slot];
+                unsigned int bin = std::min(BINS - 1, static_cast<unsigned int>((centroids[primitive][axis] - minimum) * scale));
+                bins[bin].count++;
+                bins[bin].bounds.Extend(boxes[primitive]);
+            }
+
+            // sweep from both sides, so every split's two halves are known in one pass each
+            float leftArea[BINS - 1], rightArea[BINS - 1];
+            uint32_t leftCount[BINS - 1], rightCount[BINS - 1];
+            AABB leftBox, rightBox;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (unsigned int i = 0; i < BINS - 1; i++)
+            {
+                leftSum += bins[i].count;
+                leftCount[i] = leftSum;
+                leftBox.Extend(bins[i].bounds);
+                leftArea[i] = leftBox.SurfaceArea();
+                rightSum += bins[BINS - 1 - i].count;
+                rightCount[BINS - 2 - i] = rightSum;
+                rightBox.Extend(bins[BINS - 1 - i].bounds);
+                rightArea[BINS - 2 - i] = rightBox.SurfaceArea();
+            }
+            for (unsigned int i = 0; i < BINS - 1; i++)
+            {
+                if (!leftCount[i] || !rightCount[i])
+                    continue;
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = i + 1;
+                }
+            }
+        }
+        return bestCost;
+    }
+
+    void subdivide(uint32_t nodeIndex, unsigned int nodeDepth)
+    {
+        depth = std::max(depth, nodeDepth);
+        Node& node = nodes[nodeIndex];
+        if (node.count <= 1 || nodeDepth >= MAX_DEPTH)
+            return;
+
+        AABB centroidBounds;
+        for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.count; slot++)
+            centroidBounds.Extend(centroids[primitives[slot]]);
+        int axis = 0;
+        unsigned int splitBin = 0;
+        float splitCost = findSplit(node, centroidBounds, axis, splitBin);
+        float area = node.Bounds().SurfaceArea();
+        float leafCost = node.count * area;
+        if (splitCost == FLT_MAX || TRAVERSAL_COST * area + splitCost >= leafCost)
+        {
+            if (node.count <= MAX_LEAF_SIZE)
+                return;
+        }
+
+        uint32_t first = node.leftFirst;
+        uint32_t* begin = primitives.data() + first;
+        uint32_t* end = begin + node.count;
+        uint32_t* middle;
+        if (splitCost != FLT_MAX)
+        {
+            float minimum = centroidBounds.min[axis];
+            float scale = BINS / (centroidBounds.max[axis] - minimum);
+            middle = std::partition(begin, end, [&](uint32_t primitive) {
+                return std::min(BINS - 1, static_cast<unsigned int>((centroids[primitive][axis] - minimum) * scale)) < splitBin;
+            });
+        }
+        else
+            middle = begin + node.count / 2; // all centroids in one spot: any split is as good as another
+        uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+
+        uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({ glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount });
+        nodes.push_back({ glm::vec3(0.0f), first + leftCount, glm::vec3(0.0f), node.count - leftCount });
+        node.leftFirst = leftIndex;
+        node.count = 0;
+        updateBounds(leftIndex);
+        updateBounds(leftIndex + 1);
+        subdivide(leftIndex, nodeDepth + 1);
+        subdivide(leftIndex + 1, nodeDepth + 1);
+    }
+};
+#endif
@@ -66,6 +66,14 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // returns the direction of the ray from the camera through a point on the screen, given in normalized device
+    // coordinates (-1 to 1, y up), for a viewport with the given aspect ratio. Not normalized.
+    glm::vec3 GetRayDirection(float x, float y, float aspect) const
+    {
+        float tanHalfFov = tan(glm::radians(Zoom) * 0.5f);
+        return Front + Right * (x * tanHalfFov * aspect) + Up * (y * tanHalfFov);
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
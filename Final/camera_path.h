@@ -0,0 +1,93 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the camera state of one recorded frame
+struct CameraKeyframe {
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float zoom;
+};
+
+// a camera flight recorded in the interactive application (--record) and replayed by headless runs and the
+// benchmark, so they all look at the same things. Files are text, one "x y z yaw pitch zoom" keyframe per line.
+class CameraPath
+{
+public:
+    vector<CameraKeyframe> keyframes;
+
+    void Record(const Camera& camera)
+    {
+        keyframes.push_back({ camera.Position, camera.Yaw, camera.Pitch, camera.Zoom });
+    }
+
+    bool Empty() const
+    {
+        return keyframes.empty();
+    }
+
+    bool Load(const string& path)
+    {
+        ifstream file(path);
+        if (!file)
+        {
+            cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESSFULLY_READ: " << path << endl;
+            return false;
+        }
+        keyframes.clear();
+        CameraKeyframe keyframe;
+        while (file >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.yaw >> keyframe.pitch >> keyframe.zoom)
+            keyframes.push_back(keyframe);
+        if (!file.eof() || keyframes.empty())
+        {
+            cout << "ERROR::CAMERA_PATH::INVALID_FILE " << path << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool Save(const string& path) const
+    {
+        ofstream file(path);
+        for (const CameraKeyframe& keyframe : keyframes)
+            file << keyframe.position.x << " " << keyframe.position.y << " " << keyframe.position.z << " "
+                 << keyframe.yaw << " " << keyframe.pitch << " " << keyframe.zoom << "\n";
+        if (!file)
+        {
+            cout << "ERROR::CAMERA_PATH::CANNOT_WRITE " << path << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // the camera at a point along the path, interpolated between keyframes; t runs from 0 to 1 over the path
+    Camera Sample(float t) const
+    {
+        if (keyframes.empty())
+            return Camera();
+        float position = glm::clamp(t, 0.0f, 1.0f) * static_cast<float>(keyframes.size() - 1);
+        size_t first = std::min(static_cast<size_t>(position), keyframes.size() - 1);
+        size_t second = std::min(first + 1, keyframes.size() - 1);
+        float blend = position - static_cast<float>(first);
+        const CameraKeyframe& a = keyframes[first];
+        const CameraKeyframe& b = keyframes[second];
+
+        Camera camera(glm::mix(a.position, b.position, blend), glm::vec3(0.0f, 1.0f, 0.0f),
+                      glm::mix(a.yaw, b.yaw, blend), glm::mix(a.pitch, b.pitch, blend));
+        camera.Zoom = glm::mix(a.zoom, b.zoom, blend);
+        return camera;
+    }
+};
+#endif
\ No newline at end of file
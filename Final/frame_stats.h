@@ -0,0 +1,50 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// summary of a series of frame times, in milliseconds
+struct FrameStatistics {
+    size_t frames = 0;
+    double min = 0.0, mean = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+
+    static FrameStatistics Compute(vector<double> milliseconds)
+    {
+        FrameStatistics stats;
+        stats.frames = milliseconds.size();
+        if (milliseconds.empty())
+            return stats;
+
+        std::sort(milliseconds.begin(), milliseconds.end());
+        double total = 0.0;
+        for (double value : milliseconds)
+            total += value;
+        stats.min = milliseconds.front();
+        stats.max = milliseconds.back();
+        stats.mean = total / static_cast<double>(milliseconds.size());
+        stats.p50 = percentile(milliseconds, 0.50);
+        stats.p95 = percentile(milliseconds, 0.95);
+        stats.p99 = percentile(milliseconds, 0.99);
+        return stats;
+    }
+
+    void Print(const string& label) const
+    {
+        cout << label << " " << frames << " frames: min " << min << " ms, mean " << mean << " ms, p50 " << p50
+             << " ms, p95 " << p95 << " ms, p99 " << p99 << " ms, max " << max << " ms" << endl;
+    }
+
+private:
+    // nearest-rank percentile of sorted values
+    static double percentile(const vector<double>& sorted, double fraction)
+    {
+        size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+        return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+    }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,262 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "render_stats.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// where a mesh's geometry lives inside a GeometryArena
+struct GeometryRange {
+    size_t firstVertex = 0; // also the base vertex added to every index
+    size_t vertexCount = 0;
+    size_t firstIndex = 0;
+    size_t indexCount = 0;
+};
+
+// first-fit sub-allocator over a run of element slots. Freed ranges are merged with their neighbours.
+class RangeAllocator
+{
+public:
+    static const size_t NO_SPACE = SIZE_MAX;
+
+    size_t capacity = 0;
+
+    // returns the first slot of a free run of count slots, or NO_SPACE if there is none
+    size_t allocate(size_t count)
+    {
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+        {
+            if (it->second < count)
+                continue;
+            size_t offset = it->first;
+            it->first += count;
+            it->second -= count;
+            if (it->second == 0)
+                freeRanges.erase(it);
+            return offset;
+        }
+        return NO_SPACE;
+    }
+
+    void free(size_t offset, size_t count)
+    {
+        if (count == 0)
+            return;
+        auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), make_pair(offset, size_t(0)));
+        // merge with the free range right after, then with the one right before
+        if (next != freeRanges.end() && offset + count == next->first)
+        {
+            count += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += count;
+                return;
+            }
+        }
+        freeRanges.insert(next, make_pair(offset, count));
+    }
+
+    // adds slots at the end
+    void grow(size_t newCapacity)
+    {
+        size_t oldCapacity = capacity;
+        capacity = newCapacity;
+        free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+private:
+    vector<pair<size_t, size_t>> freeRanges; // (offset, count), sorted by offset
+};
+
+// one vertex buffer, one index buffer and one VAO shared by every mesh with the same vertex format and index
+// type. Meshes only own a GeometryRange in it, so drawing any number of them needs a single VAO bind, and
+// all the meshes of a model can be submitted with one glMultiDrawElementsBaseVertex.
+// Indices are stored relative to their mesh's first vertex, which is why 16-bit indices can be shared by
+// meshes anywhere in the vertex buffer.
+class GeometryArena
+{
+public:
+    const VertexFormat format;
+    const GLenum indexType;
+
+    // the shared arena for a vertex format and index type
+    static GeometryArena& For(VertexFormat format, GLenum indexType)
+    {
+        static unique_ptr<GeometryArena> arenas[2][2];
+        unique_ptr<GeometryArena>& arena = arenas[format == VERTEX_FORMAT_PACKED][indexType == GL_UNSIGNED_SHORT];
+        if (!arena)
+            arena.reset(new GeometryArena(format, indexType));
+        return *arena;
+    }
+
+    // copies a mesh's vertices and indices into the arena. vertexData must be in the arena's vertex format and
+    // indexData of its index type.
+    GeometryRange Allocate(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount)
+    {
+        if (VAO == 0)
+            create();
+
+        GeometryRange range;
+        range.vertexCount = vertexCount;
+        range.indexCount = indexCount;
+        range.firstVertex = allocate(vertexSlots, VBO, vertexStride(), vertexCount);
+        range.firstIndex = allocate(indexSlots, EBO, indexSize(), indexCount);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstVertex * vertexStride(), vertexCount * vertexStride(), vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * indexSize(), indexCount * indexSize(), indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        liveRanges++;
+        return range;
+    }
+
+    // copies just indices into the arena, for vertices another range already holds (e.g. a level of detail of a
+    // mesh, see Mesh): the returned range has the same base vertex, but no vertices of its own
+    GeometryRange AllocateIndices(size_t firstVertex, const void* indexData, size_t indexCount)
+    {
+        GeometryRange range;
+        range.firstVertex = firstVertex;
+        range.indexCount = indexCount;
+        range.firstIndex = allocate(indexSlots, EBO, indexSize(), indexCount);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * indexSize(), indexCount * indexSize(), indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        liveRanges++;
+        return range;
+    }
+
+    // returns a range to the arena; the GL buffers are deleted along with the last one
+    void Free(const GeometryRange& range)
+    {
+        vertexSlots.free(range.firstVertex, range.vertexCount);
+        indexSlots.free(range.firstIndex, range.indexCount);
+        if (--liveRanges == 0)
+            destroy();
+    }
+
+    void Bind() const
+    {
+        GLStateCache::Instance().BindVertexArray(VAO);
+    }
+
+    unsigned int VertexArray() const
+    {
+        return VAO;
+    }
+
+    size_t vertexStride() const
+    {
+        return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+
+    size_t indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+
+    // byte offset of a range's first index, as passed to the glDrawElements family
+    const void* indexOffset(const GeometryRange& range) const
+    {
+        return reinterpret_cast<const void*>(range.firstIndex * indexSize());
+    }
+
+private:
+    // room for this many vertices / indices is reserved when the arena is first used, and it doubles from there
+    static const size_t INITIAL_VERTICES = 1 << 16;
+    static const size_t INITIAL_INDICES = 3 << 16;
+
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    RangeAllocator vertexSlots, indexSlots;
+    size_t liveRanges = 0;
+
+    GeometryArena(VertexFormat format, GLenum indexType) : format(format), indexType(indexType) {}
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    void create()
+    {
+        vertexSlots = RangeAllocator();
+        indexSlots = RangeAllocator();
+        VBO = createBuffer(INITIAL_VERTICES * vertexStride());
+        EBO = createBuffer(INITIAL_INDICES * indexSize());
+        vertexSlots.grow(INITIAL_VERTICES);
+        indexSlots.grow(INITIAL_INDICES);
+        glGenVertexArrays(1, &VAO);
+        setupVertexArray();
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+
+    static unsigned int createBuffer(size_t bytes)
+    {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    // points the VAO at the current buffers; needed again whenever a buffer was replaced by a bigger one
+    void setupVertexArray()
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (format == VERTEX_FORMAT_PACKED)
+            SetupPackedVertexAttributes();
+        else
+            SetupFullVertexAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // allocates count slots, growing the buffer (and copying its contents over on the GPU) if there's no room
+    size_t allocate(RangeAllocator& slots, unsigned int& buffer, size_t elementSize, size_t count)
+    {
+        size_t offset = slots.allocate(count);
+        if (offset != RangeAllocator::NO_SPACE)
+            return offset;
+
+        size_t newCapacity = std::max(slots.capacity * 2, slots.capacity + count);
+        unsigned int grown = createBuffer(newCapacity * elementSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, slots.capacity * elementSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = grown;
+        setupVertexArray();
+
+        slots.grow(newCapacity);
+        return slots.allocate(count);
+    }
+};
+#endif
@@ -0,0 +1,97 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+// the bundled glad loader covers OpenGL 3.3 core and nothing more, so the few newer entry points and enums the
+// optional paths use are declared and loaded here
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP PFNDISPATCHCOMPUTE)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+typedef void (APIENTRYP PFNMEMORYBARRIER)(GLbitfield barriers);
+typedef void (APIENTRYP PFNMULTIDRAWELEMENTSINDIRECT)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+typedef void (APIENTRYP PFNBUFFERSTORAGE)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// what the context offers beyond 3.3. An entry point stays null when the driver lacks it, and the flags are only set
+// when everything a path needs is there, so callers just check the flag and fall back otherwise.
+struct GLExtensions {
+    int major = 0, minor = 0;
+    bool computeAndIndirect = false; // GL 4.3: compute shaders, shader storage buffers and glMultiDrawElementsIndirect
+    bool persistentMapping = false;  // GL 4.4 or ARB_buffer_storage: persistently mapped buffers
+
+    PFNDISPATCHCOMPUTE dispatchCompute = nullptr;
+    PFNMEMORYBARRIER memoryBarrier = nullptr;
+    PFNMULTIDRAWELEMENTSINDIRECT multiDrawElementsIndirect = nullptr;
+    PFNBUFFERSTORAGE bufferStorage = nullptr;
+};
+
+inline GLExtensions glExtensions;
+
+inline bool HasGLExtension(const char* extension)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name && strcmp(name, extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+// fills in glExtensions for the current context; load is the function glad was loaded with
+inline void LoadGLExtensions(GLADloadproc load)
+{
+    GLExtensions extensions;
+    glGetIntegerv(GL_MAJOR_VERSION, &extensions.major);
+    glGetIntegerv(GL_MINOR_VERSION, &extensions.minor);
+    int version = extensions.major * 10 + extensions.minor;
+
+    if (version >= 43)
+    {
+        extensions.dispatchCompute = reinterpret_cast<PFNDISPATCHCOMPUTE>(load("glDispatchCompute"));
+        extensions.memoryBarrier = reinterpret_cast<PFNMEMORYBARRIER>(load("glMemoryBarrier"));
+        extensions.multiDrawElementsIndirect = reinterpret_cast<PFNMULTIDRAWELEMENTSINDIRECT>(load("glMultiDrawElementsIndirect"));
+    }
+    extensions.computeAndIndirect = extensions.dispatchCompute && extensions.memoryBarrier && extensions.multiDrawElementsIndirect;
+
+    if (version >= 44 || HasGLExtension("GL_ARB_buffer_storage"))
+        extensions.bufferStorage = reinterpret_cast<PFNBUFFERSTORAGE>(load("glBufferStorage"));
+    extensions.persistentMapping = extensions.bufferStorage != nullptr;
+
+    glExtensions = extensions;
+    cout << "GL::CONTEXT OpenGL " << extensions.major << "." << extensions.minor << (extensions.computeAndIndirect ? ", compute" : "")
+         << (extensions.persistentMapping ? ", buffer storage" : "") << endl;
+}
+#endif
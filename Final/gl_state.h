@@ -0,0 +1,103 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include "render_stats.h"
+
+using namespace std;
+
+// the texture units the cache keeps track of; the model shader samples far fewer
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+
+// remembers the program, vertex array and 2D textures last bound through it, and skips binding them again.
+// Binds that are made count towards renderStats, skipped ones towards renderStats.skippedBinds.
+// Anything that binds behind the cache's back (texture uploads, mesh setup) makes it stale, so drawing starts with
+// Invalidate and ends with Reset, which leaves the defaults that code expects.
+class GLStateCache
+{
+public:
+    static GLStateCache& Instance()
+    {
+        static GLStateCache instance;
+        return instance;
+    }
+
+    // forgets everything; the next bind of each kind always goes through
+    void Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+            textures[i] = UNKNOWN;
+    }
+
+    // unbinds the vertex array and makes texture unit 0 active again, as the rest of the code expects, and forgets
+    // the textures, which uploads are about to rebind
+    void Reset()
+    {
+        if (vertexArray != 0)
+            glBindVertexArray(0);
+        if (activeUnit != 0)
+            glActiveTexture(GL_TEXTURE0);
+        Invalidate();
+        vertexArray = 0;
+        activeUnit = 0;
+    }
+
+    void UseProgram(GLuint id)
+    {
+        if (program == id)
+        {
+            renderStats.skippedBinds++;
+            return;
+        }
+        glUseProgram(id);
+        program = id;
+        renderStats.shaderBinds++;
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+        {
+            renderStats.skippedBinds++;
+            return;
+        }
+        glBindVertexArray(id);
+        vertexArray = id;
+        renderStats.vertexArrayBinds++;
+    }
+
+    void BindTexture(unsigned int unit, GLuint id)
+    {
+        if (unit < GL_STATE_TEXTURE_UNITS && textures[unit] == id)
+        {
+            renderStats.skippedBinds++;
+            return;
+        }
+        if (activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_2D, id);
+        if (unit < GL_STATE_TEXTURE_UNITS)
+            textures[unit] = id;
+        renderStats.textureBinds++;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu; // never a GL name, so it never matches
+    GLuint program = UNKNOWN;
+    GLuint vertexArray = UNKNOWN;
+    GLuint activeUnit = UNKNOWN;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+
+    GLStateCache()
+    {
+        Invalidate();
+    }
+};
+#endif
@@ -0,0 +1,26 @@
+#version 430 core
+// one invocation per indirect command: sets its instance count to the number of visible instances of its group and
+// level, as counted by gpu_culling.cs
+layout (local_size_x = 64) in;
+
+struct Command
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 2) readonly buffer Counters { uint counters[]; };
+layout (std430, binding = 4) buffer Commands { Command commands[]; };
+layout (std430, binding = 5) readonly buffer CommandCounters { uint commandCounters[]; }; // the counter of each command
+
+uniform uint commandCount;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i < commandCount)
+        commands[i].instanceCount = counters[commandCounters[i]];
+}
@@ -0,0 +1,123 @@
+#version 430 core
+// one invocation per scene instance: frustum culls it, tests it against the Hi-Z pyramid of the occluders, picks its
+// level of detail and appends its transform to the visible transforms of its model and level. See gpu_culling.h for
+// the buffer layouts and hiz.h for the pyramid.
+layout (local_size_x = 64) in;
+
+// MAX_LOD_LEVELS in mesh.h
+const uint LEVELS = 4u;
+
+struct Instance
+{
+    mat4 transform;
+    vec4 sphere;      // world space bounding sphere: center, radius
+    vec4 boxMin;      // world space bounding box
+    vec4 boxMax;
+    float errorScale; // how much the transform scales the model's simplification error
+    uint group;
+    uint padding0;
+    uint padding1;
+};
+
+struct Group
+{
+    uint lodCount;
+    uint firstVisible;  // where the group's visible transforms start; each level has room for all its instances
+    uint instanceCount;
+    uint padding;
+    vec4 lodErrors;
+};
+
+layout (std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout (std430, binding = 1) readonly buffer Groups { Group groups[]; };
+// visible instances per group and level, then the frame's statistics
+layout (std430, binding = 2) buffer Counters { uint counters[]; };
+layout (std430, binding = 3) writeonly buffer Visible { mat4 visible[]; };
+
+uniform uint instanceCount;
+uniform bool cull;
+uniform vec4 planes[6];
+uniform bool selectLod;
+uniform vec3 eye;
+uniform float pixelsPerUnit;
+uniform float maxPixelError;
+uniform uint statsOffset; // where the statistics start in counters: submitted, culled, occluded, simplified
+
+uniform bool occlusion;
+uniform mat4 viewProjection; // of the pyramid
+uniform sampler2D hiZ;
+uniform ivec2 hiZSize;       // of level 0
+uniform int hiZLevels;
+
+// whether the box is behind the occluders all over its footprint, as RectOccluded in hiz.h tests it
+bool occluded(vec3 boxMin, vec3 boxMax)
+{
+    vec3 low = vec3(1.0e30), high = vec3(-1.0e30);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 p = vec3((corner & 1) != 0 ? boxMax.x : boxMin.x, (corner & 2) != 0 ? boxMax.y : boxMin.y, (corner & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = viewProjection * vec4(p, 1.0);
+        if (clip.w <= 0.0)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        low = min(low, ndc);
+        high = max(high, ndc);
+    }
+    vec2 rectMin = clamp(low.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 rectMax = clamp(high.xy * 0.5 + 0.5, 0.0, 1.0);
+    float depth = max(low.z * 0.5 + 0.5, 0.0);
+
+    vec2 texels = (rectMax - rectMin) * vec2(hiZSize);
+    float extent = max(texels.x, texels.y);
+    int level = extent > 1.0 ? min(int(ceil(log2(extent))), hiZLevels - 1) : 0;
+    ivec2 size = max(hiZSize >> level, ivec2(1));
+    ivec2 first = min(ivec2(rectMin * vec2(size)), size - 1);
+    ivec2 last = min(ivec2(rectMax * vec2(size)), size - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+    return depth > farthest;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= instanceCount)
+        return;
+    vec3 center = instances[i].sphere.xyz;
+    float radius = instances[i].sphere.w;
+    if (cull)
+        for (int p = 0; p < 6; p++)
+            if (dot(planes[p].xyz, center) + planes[p].w < -radius)
+            {
+                atomicAdd(counters[statsOffset + 1u], 1u);
+                return;
+            }
+    if (occlusion && occluded(instances[i].boxMin.xyz, instances[i].boxMax.xyz))
+    {
+        atomicAdd(counters[statsOffset + 2u], 1u);
+        return;
+    }
+
+    // as LodSelector::Select does it
+    uint g = instances[i].group;
+    uint level = 0u;
+    float distance = length(center - eye) - radius;
+    if (selectLod && distance > 0.0)
+    {
+        float maxError = maxPixelError * distance / (pixelsPerUnit * instances[i].errorScale);
+        for (uint l = groups[g].lodCount - 1u; l > 0u; l--)
+            if (groups[g].lodErrors[l] <= maxError)
+            {
+                level = l;
+                break;
+            }
+    }
+
+    atomicAdd(counters[statsOffset], 1u);
+    if (level > 0u)
+        atomicAdd(counters[statsOffset + 3u], 1u);
+    uint slot = atomicAdd(counters[g * LEVELS + level], 1u);
+    visible[groups[g].firstVisible + level * groups[g].instanceCount + slot] = instances[i].transform;
+}
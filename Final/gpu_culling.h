@@ -0,0 +1,316 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "hiz.h"
+#include "model.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "render_queue.h"
+#include "shader_c.h"
+#include "shader_m.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// an instance as gpu_culling.cs reads it (std430)
+struct GpuCullInstance {
+    glm::mat4 transform;
+    glm::vec4 sphere;  // world space center and radius
+    glm::vec4 boxMin;  // world space bounding box
+    glm::vec4 boxMax;
+    float errorScale;
+    GLuint group;
+    GLuint padding[2];
+};
+// a model's instances as gpu_culling.cs reads them (std430)
+struct GpuCullGroup {
+    GLuint lodCount;
+    GLuint firstVisible;
+    GLuint instanceCount;
+    GLuint padding;
+    glm::vec4 lodErrors;
+};
+static_assert(sizeof(GpuCullInstance) == 128, "GpuCullInstance must match the std430 layout of gpu_culling.cs");
+static_assert(sizeof(GpuCullGroup) == 32, "GpuCullGroup must match the std430 layout of gpu_culling.cs");
+static_assert(MAX_LOD_LEVELS == 4, "gpu_culling.cs keeps the errors of the levels of detail in a vec4");
+
+// culling and level of detail selection on the GPU, for GL 4.3 contexts: the instances live in shader storage
+// buffers, gpu_culling.cs appends the visible ones per model and level to a buffer of transforms, and
+// gpu_commands.cs writes the instance counts into the indirect commands, which are drawn with one
+// glMultiDrawElementsIndirect per batch. Nothing is waited for: the object counts are copied aside and added to
+// renderStats a frame or two later, once the GPU is done with them, so the last frames of a run go uncounted.
+// Frustum culling is against each instance's bounding sphere, a little coarser than the CPU route's boxes, and
+// occlusion culling against its box and a HiZBuffer built the same frame.
+class GpuCulling
+{
+public:
+    GpuCulling() = default;
+    GpuCulling(const GpuCulling&) = delete;
+    GpuCulling& operator=(const GpuCulling&) = delete;
+
+    ~GpuCulling()
+    {
+        if (!buffers[0])
+            return;
+        glDeleteBuffers(BUFFER_COUNT, buffers);
+        glDeleteBuffers(STATS_FRAMES, statsBuffers);
+        for (GLsync fence : statsFences)
+            if (fence)
+                glDeleteSync(fence);
+    }
+
+    // compiles the compute shaders; false if the context lacks GL 4.3 (see LoadGLExtensions) or they don't build
+    bool Create()
+    {
+        if (!glExtensions.computeAndIndirect)
+            return false;
+        cullShader.reset(new ComputeShader("gpu_culling.cs"));
+        commandShader.reset(new ComputeShader("gpu_commands.cs"));
+        if (!cullShader->Linked() || !commandShader->Linked())
+            return false;
+        cullUniforms.instanceCount = cullShader->uniform("instanceCount");
+        cullUniforms.cull = cullShader->uniform("cull");
+        cullUniforms.planes = cullShader->uniform("planes");
+        cullUniforms.selectLod = cullShader->uniform("selectLod");
+        cullUniforms.eye = cullShader->uniform("eye");
+        cullUniforms.pixelsPerUnit = cullShader->uniform("pixelsPerUnit");
+        cullUniforms.maxPixelError = cullShader->uniform("maxPixelError");
+        cullUniforms.statsOffset = cullShader->uniform("statsOffset");
+        cullUniforms.occlusion = cullShader->uniform("occlusion");
+        cullUniforms.hiZ = cullShader->uniform("hiZ");
+        cullUniforms.viewProjection = cullShader->uniform("viewProjection");
+        cullUniforms.hiZSize = cullShader->uniform("hiZSize");
+        cullUniforms.hiZLevels = cullShader->uniform("hiZLevels");
+        commandCountUniform = commandShader->uniform("commandCount");
+        glGenBuffers(BUFFER_COUNT, buffers);
+        glGenBuffers(STATS_FRAMES, statsBuffers);
+        for (GLuint buffer : statsBuffers)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, STATISTICS * sizeof(GLuint), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return true;
+    }
+
+    // uploads the instances and builds the indirect commands. The instances come grouped by model: groups lists
+    // each model with the number of consecutive instances placed with it.
+    void SetInstances(const vector<pair<const Model*, size_t>>& groups, const vector<glm::mat4>& transforms,
+                      const vector<BoundingSphere>& spheres, const vector<AABB>& boxes, const vector<float>& errorScales)
+    {
+        instances.resize(transforms.size());
+        vector<GpuCullGroup> groupData(groups.size());
+        vector<DrawElementsIndirectCommand> commands;
+        vector<GLuint> commandCounters;
+        batches.clear();
+        RenderQueue order;
+        size_t instance = 0, visibleSlots = 0;
+        for (size_t g = 0; g < groups.size(); g++)
+        {
+            const Model& model = *groups[g].first;
+            size_t count = groups[g].second;
+            GpuCullGroup& group = groupData[g];
+            group.lodCount = std::max(1u, model.LodCount());
+            group.firstVisible = static_cast<GLuint>(visibleSlots);
+            group.instanceCount = static_cast<GLuint>(count);
+            for (unsigned int level = 0; level < MAX_LOD_LEVELS; level++)
+                group.lodErrors[level] = model.LodError(level);
+            for (size_t i = 0; i < count; i++, instance++)
+                instances[instance] = { transforms[instance], glm::vec4(spheres[instance].center, spheres[instance].radius),
+                                        glm::vec4(boxes[instance].min, 0.0f), glm::vec4(boxes[instance].max, 0.0f),
+                                        errorScales[instance], static_cast<GLuint>(g), { 0, 0 } };
+
+            // each level gets room for all of the group's instances, right after the previous level
+            for (unsigned int level = 0; level < group.lodCount; level++)
+            {
+                GLuint baseInstance = static_cast<GLuint>(visibleSlots + level * count);
+                for (size_t batch = 0; batch < model.BatchCount(level); batch++)
+                {
+                    uint64_t key = MakeRenderKey(RENDER_PASS_OPAQUE, 0, model.BatchMaterial(level, batch), model.BatchVertexArray(level, batch), 0.0f);
+                    order.Push(key, static_cast<uint32_t>(batches.size()));
+                    batches.push_back({ &model, level, batch, commands.size() });
+                    model.AppendBatchCommands(level, batch, baseInstance, commands);
+                    commandCounters.resize(commands.size(), static_cast<GLuint>(g * MAX_LOD_LEVELS + level));
+                }
+            }
+            visibleSlots += group.lodCount * count;
+        }
+        // draw the batches in state order; their commands stay where they are
+        vector<IndirectBatch> sorted;
+        sorted.reserve(batches.size());
+        for (const RenderQueue::Item& item : order.Sort())
+            sorted.push_back(batches[item.draw]);
+        batches.swap(sorted);
+
+        commandCount = commands.size();
+        statsOffset = groups.size() * MAX_LOD_LEVELS;
+        zeros.assign(statsOffset + STATISTICS, 0);
+        upload(GL_SHADER_STORAGE_BUFFER, buffers[INSTANCES], instances);
+        upload(GL_SHADER_STORAGE_BUFFER, buffers[GROUPS], groupData);
+        upload(GL_SHADER_STORAGE_BUFFER, buffers[COUNTERS], zeros);
+        upload(GL_SHADER_STORAGE_BUFFER, buffers[COMMANDS], commands);
+        upload(GL_SHADER_STORAGE_BUFFER, buffers[COMMAND_COUNTERS], commandCounters);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[VISIBLE]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(visibleSlots, 1) * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        cout << "GPU_CULLING::INSTANCES " << instances.size() << " instances of " << groups.size() << " models, "
+             << commandCount << " indirect commands in " << batches.size() << " batches" << endl;
+    }
+
+    // moves one instance
+    void UpdateInstance(size_t instance, const glm::mat4& transform, const BoundingSphere& sphere, const AABB& box, float errorScale)
+    {
+        GpuCullInstance& data = instances[instance];
+        data.transform = transform;
+        data.sphere = glm::vec4(sphere.center, sphere.radius);
+        data.boxMin = glm::vec4(box.min, 0.0f);
+        data.boxMax = glm::vec4(box.max, 0.0f);
+        data.errorScale = errorScale;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[INSTANCES]);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, instance * sizeof(GpuCullInstance), sizeof(GpuCullInstance), &data);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // culls against the frustum (none culls nothing) and the occluders' pyramid (if any), picks the levels of detail
+    // if selectLod (as LodSelector does, from eye, pixelsPerUnit and maxPixelError) and draws what's left with the
+    // given shader
+    void Draw(const Shader& shader, const Frustum* frustum, const HiZBuffer* occluders, bool selectLod, const glm::vec3& eye,
+              float pixelsPerUnit, float maxPixelError) const
+    {
+        if (instances.empty())
+            return;
+        {
+            PROFILE_ZONE("GpuCulling::cull");
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[COUNTERS]);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, zeros.size() * sizeof(GLuint), zeros.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            for (GLuint binding = 0; binding < BUFFER_COUNT; binding++)
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[binding]);
+
+            cullShader->use();
+            cullShader->setUint(cullUniforms.instanceCount, static_cast<unsigned int>(instances.size()));
+            cullShader->setBool(cullUniforms.cull, frustum != nullptr);
+            if (frustum)
+                cullShader->setVec4Array(cullUniforms.planes, frustum->planes, 6);
+            cullShader->setBool(cullUniforms.selectLod, selectLod);
+            cullShader->setVec3(cullUniforms.eye, eye);
+            cullShader->setFloat(cullUniforms.pixelsPerUnit, pixelsPerUnit);
+            cullShader->setFloat(cullUniforms.maxPixelError, maxPixelError);
+            cullShader->setUint(cullUniforms.statsOffset, static_cast<unsigned int>(statsOffset));
+            cullShader->setBool(cullUniforms.occlusion, occluders != nullptr);
+            if (occluders)
+            {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, occluders->Pyramid());
+                cullShader->setInt(cullUniforms.hiZ, 0);
+                cullShader->setMat4(cullUniforms.viewProjection, occluders->ViewProjection());
+                cullShader->setIvec2(cullUniforms.hiZSize, occluders->Size());
+                cullShader->setInt(cullUniforms.hiZLevels, static_cast<int>(occluders->Levels()));
+            }
+            cullShader->dispatch(static_cast<unsigned int>(instances.size()), WORK_GROUP_SIZE);
+            glExtensions.memoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            commandShader->use();
+            commandShader->setUint(commandCountUniform, static_cast<unsigned int>(commandCount));
+            commandShader->dispatch(static_cast<unsigned int>(commandCount), WORK_GROUP_SIZE);
+            glExtensions.memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+            copyStats();
+        }
+
+        PROFILE_ZONE("GpuCulling::draw");
+        // the compute passes switched programs behind the state cache's back
+        GLStateCache& state = GLStateCache::Instance();
+        state.Invalidate();
+        state.UseProgram(shader.ID);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[COMMANDS]);
+        for (const IndirectBatch& batch : batches)
+            batch.model->DrawBatchIndirect(shader, buffers[VISIBLE], batch.lod, batch.batch, batch.firstCommand * sizeof(DrawElementsIndirectCommand));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        state.Reset();
+    }
+
+private:
+    // the buffers, each bound to the shader storage binding of its index
+    enum Buffer { INSTANCES, GROUPS, COUNTERS, VISIBLE, COMMANDS, COMMAND_COUNTERS, BUFFER_COUNT };
+    // the object counts gpu_culling.cs keeps after the visible instances' counters, in this order
+    enum Statistic { SUBMITTED, CULLED, OCCLUDED, SIMPLIFIED, STATISTICS };
+    static const unsigned int STATS_FRAMES = 3; // frames whose counts may be on their way back at once
+    static const unsigned int WORK_GROUP_SIZE = 64; // local_size_x of both compute shaders
+
+    struct IndirectBatch {
+        const Model* model;
+        unsigned int lod;
+        size_t batch;
+        size_t firstCommand;
+    };
+
+    GLuint buffers[BUFFER_COUNT] = {};
+    unique_ptr<ComputeShader> cullShader, commandShader;
+    // the uniforms set every frame, resolved once in Create
+    struct CullUniforms {
+        UniformHandle instanceCount, cull, planes, selectLod, eye, pixelsPerUnit, maxPixelError, statsOffset;
+        UniformHandle occlusion, hiZ, viewProjection, hiZSize, hiZLevels;
+    } cullUniforms;
+    UniformHandle commandCountUniform;
+    vector<GpuCullInstance> instances;
+    vector<IndirectBatch> batches;
+    vector<GLuint> zeros; // to reset the counters with, one per group and level and one per statistic
+    size_t commandCount = 0;
+    size_t statsOffset = 0;
+    GLuint statsBuffers[STATS_FRAMES] = {};
+    mutable GLsync statsFences[STATS_FRAMES] = {};
+    mutable unsigned int statsFrame = 0;
+
+    // copies this frame's counts aside and adds those of earlier frames to renderStats as they arrive. Only counts
+    // STATS_FRAMES frames old are waited for, which the GPU has long finished by then.
+    void copyStats() const
+    {
+        unsigned int slot = statsFrame++ % STATS_FRAMES;
+        readStats(slot, true);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffers[COUNTERS]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, statsBuffers[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, statsOffset * sizeof(GLuint), 0, STATISTICS * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        statsFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        for (unsigned int other = 1; other < STATS_FRAMES; other++)
+            readStats((slot + other) % STATS_FRAMES, false);
+    }
+
+    void readStats(unsigned int slot, bool wait) const
+    {
+        if (!statsFences[slot])
+            return;
+        GLenum status = glClientWaitSync(statsFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0);
+        if (status == GL_TIMEOUT_EXPIRED && !wait)
+            return;
+        glDeleteSync(statsFences[slot]);
+        statsFences[slot] = nullptr;
+        GLuint counts[STATISTICS];
+        glBindBuffer(GL_COPY_READ_BUFFER, statsBuffers[slot]);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), counts);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        renderStats.submittedObjects += counts[SUBMITTED];
+        renderStats.culledObjects += counts[CULLED];
+        renderStats.occludedObjects += counts[OCCLUDED];
+        renderStats.simplifiedObjects += counts[SIMPLIFIED];
+    }
+
+    template <class T>
+    static void upload(GLenum target, GLuint buffer, const vector<T>& data)
+    {
+        glBindBuffer(target, buffer);
+        // an empty buffer can't be bound to a storage binding, so there's always at least one element
+        glBufferData(target, std::max<size_t>(data.size(), 1) * sizeof(T), data.empty() ? nullptr : data.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(target, 0);
+    }
+};
+#endif
@@ -0,0 +1,309 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// on Linux the offscreen context comes from EGL, without any window system: Mesa's surfaceless platform renders
+// with llvmpipe when there is no GPU (link with -lEGL). Elsewhere, or with HEADLESS_USE_GLFW defined, it is an
+// invisible GLFW window instead, which still needs a display.
+#if defined(__linux__) && !defined(HEADLESS_USE_GLFW)
+#define HEADLESS_EGL 1
+#else
+#define HEADLESS_EGL 0
+#endif
+
+#include <glad/glad.h>
+#if HEADLESS_EGL
+#define EGL_NO_X11 // keep Xlib's macros out of everything that includes this
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+#include "gl_extensions.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// what the command line asks for
+struct RunOptions {
+    bool headless = false;
+    string scenePath;           // scene description file (see scene_description.h); the default scene if empty
+    unsigned int frames = 300;  // headless only: frames rendered along the camera path
+    unsigned int width = 800;
+    unsigned int height = 600;
+    string dumpDirectory;       // headless only: every frame is written here as a PNG if set
+    bool profile = false;       // report per-zone CPU/GPU time percentiles at exit, see profiler.h
+    string tracePath;           // write a Chrome trace of every profiled frame here if set (implies profile)
+    string cameraPath;          // headless only: replay this recorded camera path instead of the scene's orbit
+    string recordPath;          // interactive only: record the camera path of the session to this file
+    string benchmarkPath;       // run this benchmark suite (see benchmark.h) headless, instead of anything else
+    string jsonPath;            // benchmark only: write the results here instead of to standard output
+    bool bvhBenchmark = false;  // time the scene hierarchy on synthetic boxes (see RunBvhBenchmark), without rendering
+    bool occlusionBenchmark = false; // time the software occlusion rasterizer on synthetic occluders (see RunOcclusionBenchmark)
+    bool jobBenchmark = false;  // time the JobSystem on 1 to all cores (see RunJobBenchmark)
+    bool cull = true;           // frustum culling; --no-cull turns it off to compare
+    bool lod = true;            // levels of detail; --no-lod draws every object in full detail to compare
+    bool occlusion = true;      // occlusion culling (see HiZBuffer); --no-occlusion turns it off to compare
+    bool stream = false;        // headless only: stream the models in while rendering (see ModelStreamer), as the window always does
+    bool gpuCulling = false;    // ask for a GL 4.3 context and cull on the GPU (see GpuCulling), if it can be had
+    bool softwareOcclusion = false; // rasterize the occluders on the CPU (see SoftwareOcclusion) rather than read back a HiZBuffer
+};
+
+// parses --headless, --scene <file>, --frames <n>, --size <width>x<height>, --dump <directory>, --profile,
+// --trace <file>, --camera <file>, --record <file>, --benchmark <file>, --bvh-benchmark, --occlusion-benchmark,
+// --job-benchmark, --json <file>, --no-cull, --no-lod, --no-occlusion, --software-occlusion, --stream and --gpu-culling;
+// prints the usage and returns false on anything else
+inline bool ParseCommandLine(int argc, char** argv, RunOptions& options)
+{
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++)
+    {
+        string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--headless")
+            options.headless = true;
+        else if (argument == "--scene" && hasValue)
+            options.scenePath = argv[++i];
+        else if (argument == "--frames" && hasValue)
+        {
+            char* end;
+            unsigned long frames = strtoul(argv[++i], &end, 10);
+            valid = *end == '\0' && frames > 0;
+            options.frames = static_cast<unsigned int>(frames);
+        }
+        else if (argument == "--size" && hasValue)
+        {
+            unsigned int width = 0, height = 0;
+            char trailing;
+            valid = sscanf(argv[++i], "%ux%u%c", &width, &height, &trailing) == 2 && width > 0 && height > 0;
+            options.width = width;
+            options.height = height;
+        }
+        else if (argument == "--dump" && hasValue)
+            options.dumpDirectory = argv[++i];
+        else if (argument == "--camera" && hasValue)
+            options.cameraPath = argv[++i];
+        else if (argument == "--record" && hasValue)
+            options.recordPath = argv[++i];
+        else if (argument == "--benchmark" && hasValue)
+            options.benchmarkPath = argv[++i];
+        else if (argument == "--json" && hasValue)
+            options.jsonPath = argv[++i];
+        else if (argument == "--bvh-benchmark")
+            options.bvhBenchmark = true;
+        else if (argument == "--occlusion-benchmark")
+            options.occlusionBenchmark = true;
+        else if (argument == "--job-benchmark")
+            options.jobBenchmark = true;
+        else if (argument == "--no-cull")
+            options.cull = false;
+        else if (argument == "--no-lod")
+            options.lod = false;
+        else if (argument == "--no-occlusion")
+            options.occlusion = false;
+        else if (argument == "--software-occlusion")
+            options.softwareOcclusion = true;
+        else if (argument == "--stream")
+            options.stream = true;
+        else if (argument == "--gpu-culling")
+            options.gpuCulling = true;
+        else if (argument == "--profile")
+            options.profile = true;
+        else if (argument == "--trace" && hasValue)
+        {
+            options.tracePath = argv[++i];
+            options.profile = true;
+        }
+        else
+            valid = false;
+    }
+    if (!valid)
+        cout << "usage: " << argv[0] << " [--scene <file>] [--size <width>x<height>] [--no-cull] [--no-lod] [--no-occlusion] [--software-occlusion] [--gpu-culling] [--profile] [--trace <file>] [--record <file>]\n"
+             << "       " << argv[0] << " --headless [--scene <file>] [--size <width>x<height>] [--no-cull] [--no-lod] [--no-occlusion] [--software-occlusion] [--gpu-culling] [--frames <n>] [--camera <file>] [--dump <directory>] [--stream] [--profile] [--trace <file>]\n"
+             << "       " << argv[0] << " --benchmark <suite file> [--json <file>] [--no-cull] [--no-lod] [--no-occlusion] [--software-occlusion] [--gpu-culling] [--profile] [--trace <file>]\n"
+             << "       " << argv[0] << " --bvh-benchmark [--json <file>]\n"
+             << "       " << argv[0] << " --occlusion-benchmark [--json <file>]\n"
+             << "       " << argv[0] << " --job-benchmark [--json <file>]" << endl;
+    return valid;
+}
+
+// an OpenGL 3.3 (or, on request, 4.3) core context without a window. Rendering goes to an OffscreenFramebuffer.
+class HeadlessContext
+{
+public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    ~HeadlessContext()
+    {
+#if HEADLESS_EGL
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+#else
+        if (initialized)
+            glfwTerminate();
+#endif
+    }
+
+    // creates the context, makes it current and loads the GL functions. With compute, a GL 4.3 context is tried
+    // first, for GpuCulling; the code only needs 3.3 and settles for that.
+    bool Create(bool compute = false)
+    {
+        const int versions[][2] = { { 4, 3 }, { 3, 3 } };
+#if HEADLESS_EGL
+        // prefer the surfaceless platform, which needs neither a display server nor a GPU
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED" << endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        // the surface type defaults to windows, which the surfaceless platform has none of
+        const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (eglBindAPI(EGL_OPENGL_API) && eglChooseConfig(display, configAttributes, &config, 1, &configCount) && configCount > 0)
+            for (int i = compute ? 0 : 1; i < 2 && context == EGL_NO_CONTEXT; i++)
+            {
+                const EGLint contextAttributes[] = {
+                    EGL_CONTEXT_MAJOR_VERSION_KHR, versions[i][0],
+                    EGL_CONTEXT_MINOR_VERSION_KHR, versions[i][1],
+                    EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                    EGL_NONE
+                };
+                context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+            }
+        if (context == EGL_NO_CONTEXT)
+        {
+            cout << "ERROR::HEADLESS::EGL_CONTEXT_CREATION_FAILED 0x" << hex << eglGetError() << dec << endl;
+            return false;
+        }
+        // no surface at all: everything is drawn into framebuffer objects (needs EGL_KHR_surfaceless_context)
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            cout << "ERROR::HEADLESS::EGL_MAKE_CURRENT_FAILED 0x" << hex << eglGetError() << dec << endl;
+            return false;
+        }
+        GLADloadproc load = (GLADloadproc)eglGetProcAddress;
+#else
+        initialized = glfwInit() != 0;
+        GLFWwindow* window = NULL;
+        for (int i = compute ? 0 : 1; i < 2 && initialized && window == NULL; i++)
+        {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, versions[i][0]);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, versions[i][1]);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+            glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            window = glfwCreateWindow(1, 1, "LearnOpenGL", NULL, NULL);
+        }
+        if (window == NULL)
+        {
+            cout << "ERROR::HEADLESS::WINDOW_CREATION_FAILED" << endl;
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        GLADloadproc load = (GLADloadproc)glfwGetProcAddress;
+#endif
+        if (!gladLoadGLLoader(load))
+        {
+            cout << "Failed to initialize GLAD" << endl;
+            return false;
+        }
+        LoadGLExtensions(load);
+        cout << "HEADLESS::CONTEXT " << glGetString(GL_RENDERER) << ", OpenGL " << glGetString(GL_VERSION) << endl;
+        return true;
+    }
+
+private:
+#if HEADLESS_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#else
+    bool initialized = false;
+#endif
+};
+
+// a color and depth render target that frames are drawn into and read back from
+class OffscreenFramebuffer
+{
+public:
+    const unsigned int width, height;
+
+    OffscreenFramebuffer(unsigned int width, unsigned int height) : width(width), height(height)
+    {
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    OffscreenFramebuffer(const OffscreenFramebuffer&) = delete;
+    OffscreenFramebuffer& operator=(const OffscreenFramebuffer&) = delete;
+
+    ~OffscreenFramebuffer()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+    }
+
+    bool Complete() const
+    {
+        return complete;
+    }
+
+    // makes this the render target, covering all of it
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+    }
+
+    // reads the color attachment back as RGBA, bottom row first
+    void ReadPixels(vector<unsigned char>& rgba) const
+    {
+        rgba.resize(size_t(width) * height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    }
+
+private:
+    unsigned int FBO = 0, color = 0, depth = 0;
+    bool complete = false;
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,382 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "profiler.h"
+#include "shader_m.h"
+#include "uniform_ring.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+using namespace std;
+
+// the CPU test reads back the first pyramid level at most this many texels across, and reduces it further itself
+const unsigned int HIZ_READBACK_SIZE = 64;
+
+// asks Scene::Draw to skip objects hidden behind others, as seen through viewProjection (see HiZBuffer)
+struct OcclusionView {
+    glm::mat4 viewProjection;
+};
+
+// a box's footprint on screen: the rectangle it covers, in [0, 1] texture coordinates clamped to the screen, and
+// the depth of its nearest corner, as the depth buffer stores it
+struct ScreenRect {
+    glm::vec2 min, max;
+    float depth;
+
+    float Area() const
+    {
+        return (max.x - min.x) * (max.y - min.y);
+    }
+};
+
+// false if part of the box is behind the eye, where its footprint has no bounds
+inline bool ProjectBox(const AABB& box, const glm::mat4& viewProjection, ScreenRect& rect)
+{
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y,
+                                                    corner & 4 ? box.max.z : box.min.z, 1.0f);
+        if (clip.w <= 0.0f)
+            return false;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        low = glm::min(low, ndc);
+        high = glm::max(high, ndc);
+    }
+    rect.min = glm::clamp(glm::vec2(low) * 0.5f + 0.5f, 0.0f, 1.0f);
+    rect.max = glm::clamp(glm::vec2(high) * 0.5f + 0.5f, 0.0f, 1.0f);
+    rect.depth = std::max(low.z * 0.5f + 0.5f, 0.0f);
+    return true;
+}
+
+// one level of a Hi-Z pyramid on the CPU: the farthest depth below each texel, row by row
+struct HiZLevel {
+    unsigned int width = 0, height = 0;
+    vector<float> depths;
+};
+
+// fills in levels[1] and up from the level below each. Every level is a power of two across, so each texel covers
+// 2x2 or 2x1 of the one below.
+inline void ReduceHiZLevels(vector<HiZLevel>& levels)
+{
+    for (size_t level = 1; level < levels.size(); level++)
+    {
+        const HiZLevel& below = levels[level - 1];
+        HiZLevel& target = levels[level];
+        for (unsigned int y = 0; y < target.height; y++)
+            for (unsigned int x = 0; x < target.width; x++)
+            {
+                unsigned int x0 = std::min(2 * x, below.width - 1), x1 = std::min(2 * x + 1, below.width - 1);
+                unsigned int y0 = std::min(2 * y, below.height - 1), y1 = std::min(2 * y + 1, below.height - 1);
+                target.depths[y * target.width + x] = std::max(std::max(below.depths[y0 * below.width + x0], below.depths[y0 * below.width + x1]),
+                                                               std::max(below.depths[y1 * below.width + x0], below.depths[y1 * below.width + x1]));
+            }
+    }
+}
+
+// whether everything drawn into the pyramid (levels[0] the finest) is nearer than the rectangle, all over it. The
+// test looks at the level where the rectangle covers at most two texels across, so it reads four texels at most
+// unless the rectangle is smaller than a texel of the finest level.
+inline bool RectOccluded(const ScreenRect& rect, const vector<HiZLevel>& levels)
+{
+    const HiZLevel& finest = levels[0];
+    float texels = std::max((rect.max.x - rect.min.x) * finest.width, (rect.max.y - rect.min.y) * finest.height);
+    size_t level = texels > 1.0f ? static_cast<size_t>(ceil(log2(texels))) : 0;
+    const HiZLevel& source = levels[std::min(level, levels.size() - 1)];
+    unsigned int x0 = std::min(static_cast<unsigned int>(rect.min.x * source.width), source.width - 1);
+    unsigned int x1 = std::min(static_cast<unsigned int>(rect.max.x * source.width), source.width - 1);
+    unsigned int y0 = std::min(static_cast<unsigned int>(rect.min.y * source.height), source.height - 1);
+    unsigned int y1 = std::min(static_cast<unsigned int>(rect.max.y * source.height), source.height - 1);
+    float farthest = 0.0f;
+    for (unsigned int y = y0; y <= y1; y++)
+        for (unsigned int x = x0; x <= x1; x++)
+            farthest = std::max(farthest, source.depths[y * source.width + x]);
+    return rect.depth > farthest;
+}
+
+// hierarchical depth for occlusion culling. Each frame a few big objects (the occluders) are drawn into a depth
+// buffer of its own, depth only, which is then reduced into a pyramid of mip levels, each texel holding the
+// farthest depth below it. An object whose nearest point is farther than the pyramid all over its footprint is
+// hidden behind the occluders, and at the level where the footprint covers two texels across that takes four reads.
+// GpuCulling tests against the pyramid of the same frame. The CPU can't without waiting for the GPU, so a small level
+// is read back asynchronously instead and the CPU tests against the latest one that arrived, usually the previous
+// frame's, through the view it was drawn from: an object coming out from behind an occluder shows a frame late.
+class HiZBuffer
+{
+public:
+    HiZBuffer() = default;
+    HiZBuffer(const HiZBuffer&) = delete;
+    HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+    ~HiZBuffer()
+    {
+        if (!depthShader)
+            return;
+        glDeleteProgram(depthShader->ID);
+        glDeleteProgram(reduceShader->ID);
+        glDeleteFramebuffers(1, &depthFBO);
+        glDeleteFramebuffers(1, &pyramidFBO);
+        glDeleteTextures(1, &depthTexture);
+        glDeleteTextures(1, &pyramid);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteBuffers(1, &readbackBuffer);
+        if (readbackFence)
+            glDeleteSync(readbackFence);
+    }
+
+    void Create()
+    {
+        depthShader.reset(new Shader("1.model_loading.vs", "hiz_depth.fs"));
+        BindUniformBlocks(*depthShader);
+        reduceShader.reset(new Shader("hiz_reduce.vs", "hiz_reduce.fs"));
+        sourceSizeUniform = reduceShader->uniform("sourceSize");
+        targetSizeUniform = reduceShader->uniform("targetSize");
+        glGenFramebuffers(1, &depthFBO);
+        glGenFramebuffers(1, &pyramidFBO);
+        glGenTextures(1, &depthTexture);
+        glGenTextures(1, &pyramid);
+        glGenVertexArrays(1, &emptyVAO);
+        glGenBuffers(1, &readbackBuffer);
+    }
+
+    // the shader to draw the occluders with, between BeginOccluders and Build; it takes the model shader's per-draw
+    // uniforms but samples no textures, see Model::DrawBatchDepthInstanced
+    const Shader& DepthShader() const
+    {
+        return *depthShader;
+    }
+
+    // makes the occluder depth buffer, sized like the current viewport, the render target and clears it
+    void BeginOccluders()
+    {
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        resize(std::max(viewport[2], 1), std::max(viewport[3], 1));
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glViewport(0, 0, width, height);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // reduces the occluders' depth into the pyramid and restores the render target and viewport. With readback, a
+    // level is also copied back for the CPU test, unless the previous copy is still on its way.
+    void Build(const glm::mat4& viewProjection, bool readback)
+    {
+        PROFILE_ZONE("HiZBuffer::build");
+        glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+        glDisable(GL_DEPTH_TEST);
+        reduceShader->use();
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+        for (unsigned int level = 0; level < levels; level++)
+        {
+            // the level below is the only one the reduction may sample, so drawing into this one is no feedback loop
+            GLint sourceWidth = width, sourceHeight = height;
+            if (level == 0)
+                glBindTexture(GL_TEXTURE_2D, depthTexture);
+            else
+            {
+                glBindTexture(GL_TEXTURE_2D, pyramid);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+                sourceWidth = levelWidth(level - 1);
+                sourceHeight = levelHeight(level - 1);
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, level);
+            glViewport(0, 0, levelWidth(level), levelHeight(level));
+            glUniform2i(sourceSizeUniform.location, sourceWidth, sourceHeight);
+            glUniform2i(targetSizeUniform.location, levelWidth(level), levelHeight(level));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        builtViewProjection = viewProjection;
+
+        if (readback && !readbackFence)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+            glBindTexture(GL_TEXTURE_2D, pyramid);
+            glGetTexImage(GL_TEXTURE_2D, readbackLevel, GL_RED, GL_FLOAT, nullptr);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            readbackViewProjection = viewProjection;
+        }
+    }
+
+    // takes in the level read back for the CPU test if it has arrived; never waits for it
+    void Collect()
+    {
+        if (!readbackFence)
+            return;
+        GLenum status = glClientWaitSync(readbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return;
+        glDeleteSync(readbackFence);
+        readbackFence = nullptr;
+
+        HiZLevel& finest = cpuLevels[0];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+        const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, finest.depths.size() * sizeof(float), GL_MAP_READ_BIT);
+        if (data)
+        {
+            memcpy(finest.depths.data(), data, finest.depths.size() * sizeof(float));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!data)
+            return;
+        ReduceHiZLevels(cpuLevels);
+        cpuViewProjection = readbackViewProjection;
+        cpuReady = true;
+    }
+
+    // forgets the pyramid the CPU tests against, e.g. when there were no occluders to draw
+    void Discard()
+    {
+        cpuReady = false;
+    }
+
+    // whether the CPU has a pyramid to test against
+    bool Ready() const
+    {
+        return cpuReady;
+    }
+
+    // the CPU test: whether the box was hidden behind the occluders of the pyramid read back last
+    bool Occluded(const AABB& box) const
+    {
+        ScreenRect rect;
+        return ProjectBox(box, cpuViewProjection, rect) && RectOccluded(rect, cpuLevels);
+    }
+
+    // for the GPU test: the pyramid texture, its level 0 size and level count, and the view of the last Build
+    GLuint Pyramid() const
+    {
+        return pyramid;
+    }
+
+    glm::ivec2 Size() const
+    {
+        return glm::ivec2(levelWidth(0), levelHeight(0));
+    }
+
+    unsigned int Levels() const
+    {
+        return levels;
+    }
+
+    const glm::mat4& ViewProjection() const
+    {
+        return builtViewProjection;
+    }
+
+private:
+    unique_ptr<Shader> depthShader, reduceShader;
+    UniformHandle sourceSizeUniform, targetSizeUniform;
+    GLuint depthFBO = 0, pyramidFBO = 0;
+    GLuint depthTexture = 0; // the occluders' depth, viewport sized
+    GLuint pyramid = 0;      // R32F; level 0 is the viewport size rounded down to powers of two
+    GLuint emptyVAO = 0;
+    GLsizei width = 0, height = 0;
+    unsigned int levels = 0;
+    GLint viewport[4] = {};
+    GLint previousFramebuffer = 0;
+    glm::mat4 builtViewProjection = glm::mat4(1.0f);
+
+    unsigned int readbackLevel = 0;
+    GLuint readbackBuffer = 0; // pixel pack buffer the level is copied into
+    GLsync readbackFence = nullptr;
+    glm::mat4 readbackViewProjection = glm::mat4(1.0f);
+    vector<HiZLevel> cpuLevels; // from the read back level up to 1x1
+    glm::mat4 cpuViewProjection = glm::mat4(1.0f);
+    bool cpuReady = false;
+
+    GLsizei levelWidth(unsigned int level) const
+    {
+        return std::max(baseSize(width) >> level, 1);
+    }
+
+    GLsizei levelHeight(unsigned int level) const
+    {
+        return std::max(baseSize(height) >> level, 1);
+    }
+
+    // the largest power of two up to size
+    static GLsizei baseSize(GLsizei size)
+    {
+        GLsizei base = 1;
+        while (base * 2 <= size)
+            base *= 2;
+        return base;
+    }
+
+    // (re)allocates the depth buffer and the pyramid for a new viewport size
+    void resize(GLsizei newWidth, GLsizei newHeight)
+    {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::HIZ::DEPTH_FRAMEBUFFER_INCOMPLETE" << endl;
+
+        levels = 1;
+        while (levelWidth(levels - 1) > 1 || levelHeight(levels - 1) > 1)
+            levels++;
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        for (unsigned int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelWidth(level), levelHeight(level), 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+        readbackLevel = 0;
+        while (std::max(levelWidth(readbackLevel), levelHeight(readbackLevel)) > static_cast<GLsizei>(HIZ_READBACK_SIZE))
+            readbackLevel++;
+        cpuLevels.resize(levels - readbackLevel);
+        for (unsigned int level = readbackLevel; level < levels; level++)
+        {
+            HiZLevel& cpuLevel = cpuLevels[level - readbackLevel];
+            cpuLevel.width = levelWidth(level);
+            cpuLevel.height = levelHeight(level);
+            cpuLevel.depths.assign(cpuLevel.width * cpuLevel.height, 1.0f);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, cpuLevels[0].depths.size() * sizeof(float), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        // whatever is on its way was read at the old size
+        if (readbackFence)
+        {
+            glDeleteSync(readbackFence);
+            readbackFence = nullptr;
+        }
+        cpuReady = false;
+    }
+};
+#endif
@@ -0,0 +1,6 @@
+#version 330 core
+// the occluders only fill the depth buffer (see HiZBuffer)
+
+void main()
+{
+}
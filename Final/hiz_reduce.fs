@@ -0,0 +1,19 @@
+#version 330 core
+// one texel of a Hi-Z pyramid level: the farthest depth of the source texels it covers. The source is the
+// occluders' depth buffer, of any size, or the level below, which is at most twice this one's size
+out float farthest;
+
+uniform sampler2D source; // its base level is the one to reduce
+uniform ivec2 sourceSize;
+uniform ivec2 targetSize;
+
+void main()
+{
+    ivec2 target = ivec2(gl_FragCoord.xy);
+    ivec2 first = target * sourceSize / targetSize;
+    ivec2 last = min(((target + 1) * sourceSize + targetSize - 1) / targetSize, sourceSize) - 1;
+    farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+}
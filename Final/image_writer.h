@@ -0,0 +1,102 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// writes 8-bit RGBA pixels as an uncompressed PNG (deflate "stored" blocks), which any viewer or image diff tool
+// reads. rows are given bottom-up, the way glReadPixels returns them, and written top-down.
+inline bool WritePNG(const string& filename, unsigned int width, unsigned int height, const vector<unsigned char>& rgba)
+{
+    if (rgba.size() < size_t(width) * height * 4)
+        return false;
+
+    struct Crc32 {
+        uint32_t table[256];
+        Crc32()
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+        }
+        uint32_t operator()(const unsigned char* data, size_t size) const
+        {
+            uint32_t c = 0xFFFFFFFFu;
+            for (size_t i = 0; i < size; i++)
+                c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+            return c ^ 0xFFFFFFFFu;
+        }
+    };
+    static const Crc32 crc32;
+
+    auto putBigEndian = [](vector<unsigned char>& out, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<unsigned char>(value >> shift));
+    };
+    vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    auto putChunk = [&](const char* type, const vector<unsigned char>& data)
+    {
+        putBigEndian(png, static_cast<uint32_t>(data.size()));
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        putBigEndian(png, crc32(&png[start], png.size() - start));
+    };
+
+    // IHDR: 8 bits per channel, color type 6 (RGBA), no interlacing
+    vector<unsigned char> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });
+    putChunk("IHDR", header);
+
+    // the scanlines, each prefixed with filter type 0, top row first
+    size_t rowBytes = size_t(width) * 4;
+    vector<unsigned char> scanlines;
+    scanlines.reserve((rowBytes + 1) * height);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        scanlines.push_back(0);
+        const unsigned char* row = &rgba[(height - 1 - y) * rowBytes];
+        scanlines.insert(scanlines.end(), row, row + rowBytes);
+    }
+
+    // IDAT: a zlib stream of stored blocks of at most 65535 bytes, followed by the Adler-32 of the scanlines
+    vector<unsigned char> zlib = { 0x78, 0x01 };
+    size_t offset = 0;
+    do
+    {
+        size_t blockSize = std::min<size_t>(scanlines.size() - offset, 65535);
+        bool last = offset + blockSize == scanlines.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<unsigned char>(blockSize));
+        zlib.push_back(static_cast<unsigned char>(blockSize >> 8));
+        zlib.push_back(static_cast<unsigned char>(~blockSize));
+        zlib.push_back(static_cast<unsigned char>(~blockSize >> 8));
+        zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < scanlines.size());
+    uint32_t a = 1, b = 0;
+    for (unsigned char byte : scanlines)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(zlib, (b << 16) | a);
+    putChunk("IDAT", zlib);
+    putChunk("IEND", vector<unsigned char>());
+
+    ofstream file(filename, ios::binary);
+    file.write(reinterpret_cast<const char*>(png.data()), png.size());
+    return static_cast<bool>(file);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,371 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// how many jobs one thread can have queued at a time; past that, it runs the jobs it submits right away
+const size_t JOB_DEQUE_CAPACITY = 4096;
+// threads other than the job system's own workers (the GL thread, the ModelStreamer worker, ...) that can queue
+// jobs; any more run the jobs they submit right away, and only help out by stealing while they wait
+const unsigned int JOB_MAX_EXTERNAL_THREADS = 8;
+// ParallelFor cuts a loop into at most this many chunks per thread, so threads that finish early can steal from
+// the others without every chunk being a job of its own
+const size_t JOB_CHUNKS_PER_THREAD = 8;
+// how often an idle worker looks for jobs again before it goes to sleep
+const unsigned int JOB_IDLE_SPINS = 64;
+
+class JobSystem;
+
+// counts the unfinished jobs submitted with it; JobSystem::Wait runs jobs until it is zero. A counter can be
+// reused once it is, and must outlive its jobs.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool Done() const
+    {
+        return pending.load(memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+    atomic<size_t> pending{ 0 };
+};
+
+// a piece of work: run is called with the job itself. Jobs are owned by whoever submits them and must stay put
+// until their counter is done.
+struct Job {
+    void (*run)(const Job& job) = nullptr;
+    const void* context = nullptr;            // what run works on, e.g. the body of a ParallelFor
+    size_t begin = 0, end = 0;                // the range of a ParallelFor chunk
+    JobCounter* counter = nullptr;            // set by Submit
+    const JobCounter* dependency = nullptr;   // if set, the job runs only once these jobs are done
+};
+
+// the jobs queued by one thread: a Chase-Lev deque. The owner pushes and pops at the bottom without locking, other
+// threads steal from the top with a compare and swap, so the owner works newest first (still warm in its cache)
+// and thieves take the oldest work, usually the biggest part left.
+class alignas(64) JobDeque
+{
+public:
+    JobDeque()
+    {
+        for (atomic<Job*>& slot : slots)
+            slot.store(nullptr, memory_order_relaxed);
+    }
+
+    // owner only; false if the deque is full
+    bool Push(Job* job)
+    {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_acquire);
+        if (b - t >= static_cast<int64_t>(JOB_DEQUE_CAPACITY))
+            return false;
+        slots[b & (JOB_DEQUE_CAPACITY - 1)].store(job, memory_order_relaxed);
+        bottom.store(b + 1, memory_order_release);
+        return true;
+    }
+
+    // owner only: the newest job, or null if there is none
+    Job* Pop()
+    {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+        if (t > b)
+        {
+            bottom.store(b + 1, memory_order_relaxed);
+            return nullptr;
+        }
+        Job* job = slots[b & (JOB_DEQUE_CAPACITY - 1)].load(memory_order_relaxed);
+        if (t == b)
+        {
+            // the last job: a thief may be after it too
+            if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                job = nullptr;
+            bottom.store(b + 1, memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // any thread: the oldest job, or null if there is none or another thread got it first
+    Job* Steal()
+    {
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        Job* job = slots[t & (JOB_DEQUE_CAPACITY - 1)].load(memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+
+private:
+    static_assert((JOB_DEQUE_CAPACITY & (JOB_DEQUE_CAPACITY - 1)) == 0, "the deque capacity must be a power of two");
+    atomic<int64_t> top{ 0 };
+    atomic<int64_t> bottom{ 0 };
+    atomic<Job*> slots[JOB_DEQUE_CAPACITY];
+};
+
+// runs jobs on a pool of worker threads, one less than the thread count since the threads that wait for jobs help
+// run them. Every thread queues its jobs on a deque of its own, and a thread out of jobs steals from the others, so
+// there is no shared queue to contend for. Dependencies are expressed through counters: Wait on a counter (or
+// give a job one as its dependency) to run only after the jobs it counts.
+// Waiting never blocks: a waiting thread runs queued jobs, any of them, until its counter is done, so jobs can
+// submit and wait for jobs of their own. Idle workers spin briefly and then sleep until jobs are queued.
+class JobSystem
+{
+public:
+    // the job system the engine shares, with a thread per core
+    static JobSystem& Instance()
+    {
+        static JobSystem jobs(thread::hardware_concurrency());
+        return jobs;
+    }
+
+    explicit JobSystem(unsigned int threadCount)
+        : threads(std::max(threadCount, 1u)), id(nextId()), deques(new JobDeque[threads - 1 + JOB_MAX_EXTERNAL_THREADS])
+    {
+        for (unsigned int i = 0; i + 1 < threads; i++)
+            workers.emplace_back(&JobSystem::work, this, i);
+    }
+
+    ~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // the threads jobs run on: the workers and one that waits
+    unsigned int Threads() const
+    {
+        return threads;
+    }
+
+    // queues the jobs, counting them on counter
+    void Submit(Job* jobs, size_t count, JobCounter& counter)
+    {
+        if (count == 0)
+            return;
+        counter.pending.fetch_add(count, memory_order_relaxed);
+        JobDeque* own = ownDeque();
+        size_t queuedCount = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            jobs[i].counter = &counter;
+            if (own && own->Push(&jobs[i]))
+                queuedCount++;
+            else
+                execute(&jobs[i]);
+        }
+        if (queuedCount == 0)
+            return;
+        queued.fetch_add(static_cast<int64_t>(queuedCount));
+        if (sleeping.load() > 0)
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            wake.notify_all();
+        }
+    }
+
+    // runs queued jobs until the counter is done
+    void Wait(const JobCounter& counter)
+    {
+        int own = ownIndex();
+        while (!counter.Done())
+        {
+            Job* job = take(own);
+            if (job)
+                execute(job);
+            else
+                this_thread::yield();
+        }
+    }
+
+    // calls body(begin, end) over [0, count) in chunks of at least grain, in parallel, and returns once all are done
+    template <typename Body>
+    void ParallelFor(size_t count, size_t grain, const Body& body)
+    {
+        if (count == 0)
+            return;
+        size_t chunkSize = std::max({ grain, size_t(1), (count + threads * JOB_CHUNKS_PER_THREAD - 1) / (threads * JOB_CHUNKS_PER_THREAD) });
+        size_t chunks = (count + chunkSize - 1) / chunkSize;
+        if (threads == 1 || chunks == 1)
+        {
+            body(size_t(0), count);
+            return;
+        }
+        // the jobs live in the calling thread's scratch block for this nesting level, so per-frame loops don't allocate
+        JobScratch& scratch = jobScratch();
+        if (scratch.depth == scratch.levels.size())
+            scratch.levels.emplace_back();
+        vector<Job>& jobs = scratch.levels[scratch.depth++];
+        if (jobs.size() < chunks)
+            jobs.resize(chunks);
+        for (size_t i = 0; i < chunks; i++)
+        {
+            jobs[i] = Job();
+            jobs[i].run = &runChunk<Body>;
+            jobs[i].context = &body;
+            jobs[i].begin = i * chunkSize;
+            jobs[i].end = std::min(count, (i + 1) * chunkSize);
+        }
+        JobCounter counter;
+        Submit(jobs.data(), chunks, counter);
+        Wait(counter);
+        scratch.depth--;
+    }
+
+private:
+    const unsigned int threads;
+    const uint64_t id; // tells job systems apart in the threads' registrations, see ownIndex
+    unique_ptr<JobDeque[]> deques; // the workers' first, then those of the external threads
+    vector<thread> workers;
+    atomic<unsigned int> externalThreads{ 0 };
+    atomic<int64_t> queued{ 0 };   // jobs on any deque; briefly off while jobs are being queued or taken
+    atomic<unsigned int> sleeping{ 0 };
+    mutex sleepMutex;
+    condition_variable wake;
+    bool stopping = false;
+
+    // the jobs of the ParallelFors running on a thread, a block per nesting level: a waiting thread runs other jobs,
+    // which may run ParallelFors of their own. Blocks are kept, so once a thread has run ParallelFors as wide and as
+    // deeply nested before, it allocates nothing; the deque never moves the blocks queued jobs point into.
+    struct JobScratch {
+        deque<vector<Job>> levels;
+        size_t depth = 0;
+    };
+
+    static JobScratch& jobScratch()
+    {
+        static thread_local JobScratch scratch;
+        return scratch;
+    }
+
+    static uint64_t nextId()
+    {
+        static atomic<uint64_t> ids{ 0 };
+        return ids++;
+    }
+
+    unsigned int dequeCount() const
+    {
+        return threads - 1 + JOB_MAX_EXTERNAL_THREADS;
+    }
+
+    // which deque the calling thread owns in this job system, claiming one on its first call; -1 if all are taken
+    int ownIndex(int workerIndex = -1)
+    {
+        static thread_local vector<pair<uint64_t, int>> registrations;
+        for (const pair<uint64_t, int>& registration : registrations)
+            if (registration.first == id)
+                return registration.second;
+        int index = workerIndex;
+        if (index < 0)
+        {
+            unsigned int external = externalThreads++;
+            index = external < JOB_MAX_EXTERNAL_THREADS ? static_cast<int>(threads - 1 + external) : -1;
+        }
+        registrations.push_back({ id, index });
+        return index;
+    }
+
+    JobDeque* ownDeque()
+    {
+        int index = ownIndex();
+        return index < 0 ? nullptr : &deques[index];
+    }
+
+    // the calling thread's newest job, or else one stolen from another thread
+    Job* take(int own)
+    {
+        if (own >= 0)
+            if (Job* job = deques[own].Pop())
+            {
+                queued.fetch_sub(1, memory_order_relaxed);
+                return job;
+            }
+        unsigned int count = dequeCount();
+        unsigned int start = own >= 0 ? static_cast<unsigned int>(own) + 1 : 0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            unsigned int victim = (start + i) % count;
+            if (static_cast<int>(victim) == own)
+                continue;
+            if (Job* job = deques[victim].Steal())
+            {
+                queued.fetch_sub(1, memory_order_relaxed);
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void execute(Job* job)
+    {
+        if (job->dependency)
+            Wait(*job->dependency);
+        JobCounter* counter = job->counter;
+        job->run(*job);
+        counter->pending.fetch_sub(1, memory_order_release);
+    }
+
+    template <typename Body>
+    static void runChunk(const Job& job)
+    {
+        (*static_cast<const Body*>(job.context))(job.begin, job.end);
+    }
+
+    void work(unsigned int index)
+    {
+        int own = ownIndex(static_cast<int>(index));
+        unsigned int idle = 0;
+        for (;;)
+        {
+            if (Job* job = take(own))
+            {
+                execute(job);
+                idle = 0;
+                continue;
+            }
+            if (++idle < JOB_IDLE_SPINS)
+            {
+                this_thread::yield();
+                continue;
+            }
+            unique_lock<mutex> lock(sleepMutex);
+            sleeping++;
+            wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+            sleeping--;
+            if (stopping)
+                return;
+            idle = 0;
+        }
+    }
+};
+#endif
@@ -8,18 +8,60 @@
 #include "shader_m.h"
 #include "camera.h"
 #include "model.h"
-
+#include "model_streamer.h"
+#include "scene.h"
+#include "scene_description.h"
+#include "headless.h"
+#include "frame_stats.h"
+#include "image_writer.h"
+#include "camera_path.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "uniform_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <filesystem>
+#include <memory>
+#include <new>
+#include <system_error>
+
+// counts every heap allocation on any thread, so the render loop can check that it performs none: the window warns
+// about frames that allocate, headless runs fail on them and benchmarks report allocations_per_frame.
+static std::atomic<size_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void processInput(GLFWwindow* window);
-void renderScene(Shader shader, Model obj);
+void renderScene(const Shader& shader, const Scene& scene, const Frustum* frustum, const LodSelector* lod, const glm::vec3& eye, const OcclusionView* occlusion);
+void renderFrame(const Shader& shader, const Scene& scene, const glm::mat4& projection, const glm::mat4& view, float viewportHeight);
+int runHeadless(const RunOptions& options, const SceneDescription& description);
+int runBenchmarks(const RunOptions& options);
+void cameraAt(const SceneDescription& description, const CameraPath& path, float t, float aspect, glm::mat4& projection, glm::mat4& view);
+void streamScene(ModelStreamer& streamer, StreamedScene& streamed, Scene& scene);
+void startProfiling(const RunOptions& options);
+void finishProfiling(const RunOptions& options);
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// GL time a frame may spend uploading streamed models
+const double STREAMING_BUDGET_MILLISECONDS = 4.0;
+// frames of a headless run that may still allocate, e.g. the uniform ring and culling buffers being created
+const unsigned int ALLOCATION_WARMUP_FRAMES = 10;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -27,18 +69,50 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// culling and levels of detail
+bool frustumCulling = true;
+bool levelOfDetail = true;
+bool occlusionCulling = true;
+
+// picking: the scene the mouse picks from, while the render loop runs
+const Scene* pickScene = nullptr;
+
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 // models
 
-int main()
+int main(int argc, char** argv)
 {
+    // command line: which scene to show, and whether to render it offscreen instead of in a window
+    // ------------------------------------------------------------------------------------------------
+    RunOptions options;
+    options.width = SCR_WIDTH;
+    options.height = SCR_HEIGHT;
+    if (!ParseCommandLine(argc, argv, options))
+        return -1;
+    frustumCulling = options.cull;
+    levelOfDetail = options.lod;
+    occlusionCulling = options.occlusion;
+    if (options.bvhBenchmark)
+        return RunBvhBenchmark(options.jsonPath);
+    if (options.occlusionBenchmark)
+        return RunOcclusionBenchmark(options.jsonPath);
+    if (options.jobBenchmark)
+        return RunJobBenchmark(options.jsonPath);
+    if (!options.benchmarkPath.empty())
+        return runBenchmarks(options);
+    SceneDescription description = SceneDescription::Default();
+    if (!options.scenePath.empty() && !LoadSceneDescription(options.scenePath, description))
+        return -1;
+    if (options.headless)
+        return runHeadless(options, description);
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, options.gpuCulling ? 4 : 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -48,7 +122,13 @@ int main()
 
     // glfw window creation
     // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    GLFWwindow* window = glfwCreateWindow(options.width, options.height, "LearnOpenGL", NULL, NULL);
+    if (window == NULL && options.gpuCulling)
+    {
+        // no GL 4.3 here: GPU culling falls back to the CPU
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        window = glfwCreateWindow(options.width, options.height, "LearnOpenGL", NULL, NULL);
+    }
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -59,6 +139,7 @@ int main()
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -70,6 +151,7 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    LoadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     //stbi_set_flip_vertically_on_load(true);
@@ -77,57 +159,82 @@ int main()
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
+    startProfiling(options);
 
-    // build and compile shaders
-    // -------------------------
-    Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
-
-    // load models
-    // -----------
-    //Model ourModel("resources/objects/backpack/backpack.obj");
-    //Model ourModel2("resources/objects/tree2/tree.obj");
-    //Model ourModel3("resources/objects/tree3/tree4.obj");
-
-
-    // draw in wireframe
-    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
+    // models and meshes free their GL objects when destroyed, so keep them in a scope that ends before the context does
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // input
-        // -----
-        processInput(window);
-
-        // render
-        // ------
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // don't forget to enable shader before setting uniforms
-        ourShader.use();
-
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // render the loaded model
-        renderScene(ourShader, ourModel3);
-
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // build and compile shaders
+        // -------------------------
+        Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
+        BindUniformBlocks(ourShader);
+
+        // stream the models in: the window opens right away and objects appear as their models arrive.
+        // the streamer is declared first, so it is destroyed last, after the scene drawing its models
+        // ----------------------------------------------------------------------------------------------
+        ModelStreamer streamer;
+        StreamedScene streamed;
+        Scene scene;
+        if (options.gpuCulling)
+            scene.UseGpuCulling();
+        if (options.softwareOcclusion)
+            scene.UseSoftwareOcclusion();
+        streamed.Start(description, streamer);
+        pickScene = &scene;
+
+
+        // draw in wireframe
+        //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+        // with --record, the camera of every frame is kept, to replay the flight in headless runs and benchmarks
+        CameraPath recording;
+
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(window))
+        {
+            // per-frame time logic
+            // --------------------
+            Profiler::Instance().BeginFrame();
+            float currentFrame = static_cast<float>(glfwGetTime());
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            // input
+            // -----
+            {
+                PROFILE_ZONE("processInput");
+                processInput(window);
+            }
+
+            // frames that stream models in, or place the last of them in the scene, allocate for them: only the render
+            // path of the others is checked
+            bool streaming = !streamed.Placed() || streamer.Busy() > 0;
+            streamScene(streamer, streamed, scene);
+            size_t allocationsBefore = allocationCount;
+
+            // render
+            // ------
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)options.width / (float)options.height, 0.1f, 100.0f);
+            renderFrame(ourShader, scene, projection, camera.GetViewMatrix(), (float)options.height);
+            if (!options.recordPath.empty())
+                recording.Record(camera);
+            if (!streaming && allocationCount != allocationsBefore)
+                std::cout << "WARNING::RENDER:: " << (allocationCount - allocationsBefore) << " heap allocations in one frame" << std::endl;
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            {
+                PROFILE_ZONE("glfwSwapBuffers");
+                glfwSwapBuffers(window);
+            }
+            glfwPollEvents();
+            Profiler::Instance().EndFrame();
+        }
+        pickScene = nullptr;
+        finishProfiling(options);
+        UniformRing::Instance().Release();
+        if (!options.recordPath.empty() && recording.Save(options.recordPath))
+            std::cout << "CAMERA_PATH::RECORDED " << recording.keyframes.size() << " frames to " << options.recordPath << std::endl;
     }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
@@ -192,11 +299,336 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-void renderScene(Shader shader, Model obj)
+// glfw: whenever a mouse button is pressed, this callback is called. The cursor is captured, so a left click
+// picks whatever is in the middle of the screen.
+// -------------------------------------------------------------------------------------------------------------
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS || !pickScene)
+        return;
+    size_t object;
+    float distance = 100.0f; // the far plane
+    if (pickScene->Pick(camera.Position, camera.GetRayDirection(0.0f, 0.0f, 1.0f), object, distance))
+        std::cout << "SCENE::PICK object " << object << " (" << pickScene->objects[object].model->directory << ") at distance " << distance << std::endl;
+    else
+        std::cout << "SCENE::PICK nothing" << std::endl;
+}
+
+void renderScene(const Shader& shader, const Scene& scene, const Frustum* frustum, const LodSelector* lod, const glm::vec3& eye, const OcclusionView* occlusion)
+{
+    scene.Draw(shader, frustum, lod, &eye, occlusion);
+}
+
+// clears the render target and draws the scene with the given view/projection transformations, into a viewport
+// viewportHeight pixels high
+void renderFrame(const Shader& shader, const Scene& scene, const glm::mat4& projection, const glm::mat4& view, float viewportHeight)
+{
+    {
+        PROFILE_ZONE("clear");
+        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    {
+        PROFILE_ZONE("uniforms");
+        // the per-frame uniforms go into the uniform ring; the scene binds the shader itself, see GLStateCache
+        UniformRing::Instance().BeginFrame();
+        FrameUniforms frameUniforms = { projection, view, projection * view };
+        UniformRing::Instance().Bind(FRAME_UNIFORM_BINDING, frameUniforms);
+    }
+
+    // render the loaded scene
+    // skipping whatever is outside the view or hidden behind nearer objects, and with less detail where it can't be seen
+    {
+        PROFILE_ZONE("renderScene");
+        Frustum frustum = Frustum::FromMatrix(projection * view);
+        LodSelector lod = LodSelector::For(projection, view, viewportHeight);
+        OcclusionView occlusion = { projection * view };
+        renderScene(shader, scene, frustumCulling ? &frustum : nullptr, levelOfDetail ? &lod : nullptr, lod.eye,
+                    occlusionCulling ? &occlusion : nullptr);
+    }
+    UniformRing::Instance().EndFrame();
+}
+
+// headless mode: renders the scene along the description's camera path into an offscreen framebuffer, without
+// a window, and prints frame time statistics. With --dump every frame is also written out as a PNG. Returns 1 if
+// any frame past the warm-up allocated on the heap while not streaming, so scripts can gate changes on it.
+int runHeadless(const RunOptions& options, const SceneDescription& description)
+{
+    CameraPath cameraPath;
+    if (!options.cameraPath.empty() && !cameraPath.Load(options.cameraPath))
+        return -1;
+
+    // declared first so it is destroyed last, after every GL object below
+    HeadlessContext context;
+    if (!context.Create(options.gpuCulling))
+        return -1;
+    glEnable(GL_DEPTH_TEST);
+    startProfiling(options);
+
+    if (!options.dumpDirectory.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(options.dumpDirectory, ec);
+        if (ec)
+        {
+            std::cout << "ERROR::HEADLESS::CANNOT_CREATE_DIRECTORY " << options.dumpDirectory << ": " << ec.message() << std::endl;
+            return -1;
+        }
+    }
+
+    int status = 0;
+    {
+        OffscreenFramebuffer framebuffer(options.width, options.height);
+        if (!framebuffer.Complete())
+            return -1;
+
+        Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
+        BindUniformBlocks(ourShader);
+
+        // with --stream the models load while the frames render, which measures the hitches loading causes
+        ModelStreamer streamer;
+        StreamedScene streamed;
+        vector<unique_ptr<Model>> models;
+        Scene scene;
+        if (options.gpuCulling)
+            scene.UseGpuCulling();
+        if (options.softwareOcclusion)
+            scene.UseSoftwareOcclusion();
+        if (options.stream)
+            streamed.Start(description, streamer);
+        else
+        {
+            BuildScene(description, models, scene);
+            scene.ReportMemory();
+        }
+
+        glm::mat4 projection, view;
+        vector<double> frameMilliseconds;
+        frameMilliseconds.reserve(options.frames);
+        vector<unsigned char> pixels;
+        framebuffer.Bind();
+        renderStats = RenderStats();
+        unsigned int allocatingFrames = 0;
+        for (unsigned int frame = 0; frame < options.frames; frame++)
+        {
+            Profiler::Instance().BeginFrame();
+            auto start = std::chrono::steady_clock::now();
+            bool streaming = !streamed.Placed() || streamer.Busy() > 0;
+            streamScene(streamer, streamed, scene);
+            size_t allocationsBefore = allocationCount;
+            cameraAt(description, cameraPath, (float)frame / (float)options.frames, (float)options.width / (float)options.height, projection, view);
+            renderFrame(ourShader, scene, projection, view, (float)options.height);
+            {
+                // wait for the GPU, so the frame time covers the rendering itself and not just its submission
+                PROFILE_ZONE("glFinish");
+                glFinish();
+            }
+            frameMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            if (!streaming && frame >= ALLOCATION_WARMUP_FRAMES && allocationCount != allocationsBefore)
+            {
+                std::cout << "ERROR::HEADLESS::FRAME_ALLOCATIONS frame " << frame << ": " << (allocationCount - allocationsBefore)
+                          << " heap allocations" << std::endl;
+                allocatingFrames++;
+            }
+            Profiler::Instance().EndFrame();
+
+            // reading back and writing the image is not part of the frame time
+            if (!options.dumpDirectory.empty())
+            {
+                framebuffer.ReadPixels(pixels);
+                char filename[32];
+                snprintf(filename, sizeof(filename), "frame_%05u.png", frame);
+                std::filesystem::path path = std::filesystem::path(options.dumpDirectory) / filename;
+                if (!WritePNG(path.string(), framebuffer.width, framebuffer.height, pixels))
+                    std::cout << "ERROR::HEADLESS::CANNOT_WRITE_FRAME " << path.string() << std::endl;
+            }
+        }
+        FrameStatistics::Compute(frameMilliseconds).Print("HEADLESS::FRAMES");
+        std::cout << "HEADLESS::CULLING " << (double)renderStats.submittedObjects / options.frames << " objects drawn, "
+                  << (double)renderStats.culledObjects / options.frames << " culled, "
+                  << (double)renderStats.occludedObjects / options.frames << " occluded, "
+                  << (double)renderStats.simplifiedObjects / options.frames << " at a lower level of detail per frame" << std::endl;
+        std::cout << "HEADLESS::STATE " << (double)renderStats.StateChanges() / options.frames << " state changes, "
+                  << (double)renderStats.skippedBinds / options.frames << " skipped as redundant per frame" << std::endl;
+        std::cout << "HEADLESS::ALLOCATIONS " << allocatingFrames << " frames allocated on the heap" << std::endl;
+        if (allocatingFrames > 0)
+            status = 1;
+        finishProfiling(options);
+        UniformRing::Instance().Release();
+    }
+    return status;
+}
+
+// benchmark mode: renders every benchmark of the suite headless, the same way as runHeadless, and reports the
+// results as JSON. Returns 1 if any budget was exceeded, so scripts can gate changes on it.
+int runBenchmarks(const RunOptions& options)
+{
+    // read all scene descriptions and camera paths up front, so a broken suite fails before anything is measured
+    BenchmarkSuite suite;
+    if (!LoadBenchmarkSuite(options.benchmarkPath, suite))
+        return -1;
+    vector<SceneDescription> descriptions(suite.cases.size());
+    vector<CameraPath> cameraPaths(suite.cases.size());
+    for (size_t i = 0; i < suite.cases.size(); i++)
+    {
+        if (!LoadSceneDescription(suite.cases[i].scenePath, descriptions[i]))
+            return -1;
+        if (!suite.cases[i].cameraPath.empty() && !cameraPaths[i].Load(suite.cases[i].cameraPath))
+            return -1;
+    }
+
+    HeadlessContext context;
+    if (!context.Create(options.gpuCulling))
+        return -1;
+    glEnable(GL_DEPTH_TEST);
+    startProfiling(options);
+
+    vector<BenchmarkResult> results;
+    {
+        OffscreenFramebuffer framebuffer(suite.width, suite.height);
+        if (!framebuffer.Complete())
+            return -1;
+
+        Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
+        BindUniformBlocks(ourShader);
+        framebuffer.Bind();
+
+        for (size_t i = 0; i < suite.cases.size(); i++)
+        {
+            const BenchmarkCase& benchmark = suite.cases[i];
+            BenchmarkResult result;
+            result.name = benchmark.name;
+
+            // every benchmark loads its scene from scratch (the mesh cache aside) and frees it again afterwards
+            vector<unique_ptr<Model>> models;
+            Scene scene;
+            if (options.gpuCulling)
+                scene.UseGpuCulling();
+            if (options.softwareOcclusion)
+                scene.UseSoftwareOcclusion();
+            auto loadStart = std::chrono::steady_clock::now();
+            BuildScene(descriptions[i], models, scene);
+            result.loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+            for (const unique_ptr<Model>& model : models)
+                result.loadedFromCache = result.loadedFromCache && model->loadedFromCache;
+            Scene::Memory memory = scene.GpuMemory();
+            result.objects = scene.objects.size();
+            result.models = memory.models;
+            result.vertexBytes = memory.vertexBytes;
+            result.indexBytes = memory.indexBytes;
+            result.textures = TextureRegistry::Instance().UniqueCount();
+
+            glm::mat4 projection, view;
+            vector<double> frameMilliseconds;
+            frameMilliseconds.reserve(benchmark.frames);
+            RenderStats totals;
+            size_t allocations = 0;
+            for (unsigned int frame = 0; frame < suite.warmupFrames + benchmark.frames; frame++)
+            {
+                // the warm-up frames all look from the start of the path
+                bool measured = frame >= suite.warmupFrames;
+                float t = measured ? (float)(frame - suite.warmupFrames) / (float)benchmark.frames : 0.0f;
+                cameraAt(descriptions[i], cameraPaths[i], t, (float)suite.width / (float)suite.height, projection, view);
+
+                Profiler::Instance().BeginFrame();
+                renderStats = RenderStats();
+                size_t allocationsBefore = allocationCount;
+                auto start = std::chrono::steady_clock::now();
+                renderFrame(ourShader, scene, projection, view, (float)suite.height);
+                glFinish();
+                double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                size_t frameAllocations = allocationCount - allocationsBefore;
+                Profiler::Instance().EndFrame();
+
+                if (!measured)
+                    continue;
+                frameMilliseconds.push_back(milliseconds);
+                allocations += frameAllocations;
+                totals.drawCalls += renderStats.drawCalls;
+                totals.drawnMeshes += renderStats.drawnMeshes;
+                totals.triangles += renderStats.triangles;
+                totals.shaderBinds += renderStats.shaderBinds;
+                totals.vertexArrayBinds += renderStats.vertexArrayBinds;
+                totals.textureBinds += renderStats.textureBinds;
+                totals.skippedBinds += renderStats.skippedBinds;
+                totals.submittedObjects += renderStats.submittedObjects;
+                totals.culledObjects += renderStats.culledObjects;
+                totals.occludedObjects += renderStats.occludedObjects;
+                totals.simplifiedObjects += renderStats.simplifiedObjects;
+                totals.uniformBlocks += renderStats.uniformBlocks;
+            }
+            result.frames = FrameStatistics::Compute(frameMilliseconds);
+            result.drawCalls = (double)totals.drawCalls / (double)benchmark.frames;
+            result.drawnMeshes = (double)totals.drawnMeshes / (double)benchmark.frames;
+            result.triangles = (double)totals.triangles / (double)benchmark.frames;
+            result.stateChanges = (double)totals.StateChanges() / (double)benchmark.frames;
+            result.skippedStateChanges = (double)totals.skippedBinds / (double)benchmark.frames;
+            result.submittedObjects = (double)totals.submittedObjects / (double)benchmark.frames;
+            result.culledObjects = (double)totals.culledObjects / (double)benchmark.frames;
+            result.occludedObjects = (double)totals.occludedObjects / (double)benchmark.frames;
+            result.simplifiedObjects = (double)totals.simplifiedObjects / (double)benchmark.frames;
+            result.uniformBlocks = (double)totals.uniformBlocks / (double)benchmark.frames;
+            result.allocationsPerFrame = (double)allocations / (double)benchmark.frames;
+
+            std::cout << "BENCHMARK::RESULT " << result.name << ": load " << result.loadMilliseconds << " ms, "
+                      << result.drawCalls << " draw calls, " << result.stateChanges << " state changes (" << result.skippedStateChanges << " skipped), "
+                      << result.submittedObjects << " objects drawn (" << result.simplifiedObjects << " simplified) and "
+                      << result.culledObjects << " culled, " << result.occludedObjects << " occluded, " << result.allocationsPerFrame
+                      << " heap allocations per frame" << std::endl;
+            result.frames.Print("BENCHMARK::FRAMES " + result.name);
+            results.push_back(result);
+        }
+        finishProfiling(options);
+        UniformRing::Instance().Release();
+    }
+
+    if (!WriteBenchmarkJson(options.jsonPath, suite, results))
+        return -1;
+    return CheckBenchmarkBudgets(suite, results) ? 0 : 1;
+}
+
+// the camera at t (0 to 1) of a headless run: along the recorded path if there is one, on the scene's orbit otherwise
+void cameraAt(const SceneDescription& description, const CameraPath& path, float t, float aspect, glm::mat4& projection, glm::mat4& view)
+{
+    float zoom = ZOOM;
+    if (path.Empty())
+        view = description.OrbitView(t);
+    else
+    {
+        Camera sample = path.Sample(t);
+        view = sample.GetViewMatrix();
+        zoom = sample.Zoom;
+    }
+    projection = glm::perspective(glm::radians(zoom), aspect, 0.1f, 100.0f);
+}
+
+// the per-frame part of streaming: uploads what the streamer has ready, within the frame's budget, and places the
+// models that arrived in the scene
+void streamScene(ModelStreamer& streamer, StreamedScene& streamed, Scene& scene)
+{
+    if (streamed.Placed() && streamer.Busy() == 0)
+        return;
+    PROFILE_ZONE("streamScene");
+    streamer.Update(STREAMING_BUDGET_MILLISECONDS);
+    if (streamed.Update(scene) && streamed.Placed())
+        scene.ReportMemory();
+}
+
+// turns the profiler on if the command line asks for it; needs the GL context
+void startProfiling(const RunOptions& options)
+{
+    if (options.profile)
+        Profiler::Instance().Enable(!options.tracePath.empty());
+}
+
+// reports what the profiler recorded and releases its queries; must run while the GL context still exists
+void finishProfiling(const RunOptions& options)
 {
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-    model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-    shader.setMat4("model", model);
-    obj.Draw(shader);
+    if (!Profiler::active)
+        return;
+    Profiler::Instance().Disable();
+    Profiler::Instance().Report();
+    if (!options.tracePath.empty() && Profiler::Instance().WriteChromeTrace(options.tracePath))
+        std::cout << "PROFILER::TRACE written to " << options.tracePath << std::endl;
 }
\ No newline at end of file
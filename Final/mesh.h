@@ -6,67 +6,233 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "bounds.h"
+#include "geometry_arena.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "render_stats.h"
 #include "shader.h"
+#include "uniform_ring.h"
+#include "vertex_format.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-    //bone indexes which will influence this vertex
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    //weights from each bone
-    float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// the full mesh and up to this many levels of detail in all: every level has about half the triangles of the one
+// before (see GenerateLods)
+const unsigned int MAX_LOD_LEVELS = 4;
+
+// a simplified version of a mesh. Its indices refer to the mesh's own vertices, so it only adds an index range to
+// the arena, with the same base vertex as the mesh.
+struct MeshLod {
+    vector<unsigned int> indices;
+    float error = 0.0f; // how far the level strays from the full mesh, in model units
+    GeometryRange range;
+};
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    VertexFormat format = VERTEX_FORMAT_FULL; // layout of the vertices in the GPU vertex buffer
+    GLenum indexType = GL_UNSIGNED_INT;       // GL_UNSIGNED_SHORT whenever every index fits in 16 bits
+    GeometryArena* arena = nullptr;           // the shared buffers holding this mesh's geometry
+    GeometryRange range;                      // and where in them it is
+    PositionQuantization quantization;        // identity unless the positions are packed
+    AABB bounds;                              // of the vertex positions, in model space
+    BoundingSphere boundingSphere;
+    vector<MeshLod> lods;                     // levels of detail 1 and up, coarsest last; the mesh itself is level 0
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor. Packed positions are quantized to the mesh's own bounds, unless a quantization is given:
+    // meshes drawn together in one multi-draw must share it (see Model).
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const PositionQuantization* sharedQuantization = nullptr, vector<MeshLod> lods = {})
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->lods = std::move(lods);
+        ComputeBounds(this->vertices.size(), [this](size_t i) { return this->vertices[i].Position; }, bounds, boundingSphere);
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        // the packed layout has no room for bone influences, so only meshes without any use it
+        format = hasBoneWeights() ? VERTEX_FORMAT_FULL : VERTEX_FORMAT_PACKED;
+        if (format == VERTEX_FORMAT_PACKED)
+            quantization = sharedQuantization ? *sharedQuantization : QuantizationForBounds(this->vertices);
+
+        // resolve the sampler uniform names once, so drawing doesn't have to build strings every frame.
+        setupSamplers();
+        // now that we have all the required data, copy it into the shared vertex and index buffers.
         setupMesh();
     }
 
+    // a mesh owns its range of the geometry arena, so it can be moved but never copied.
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    Mesh& operator=(Mesh&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            format = other.format;
+            indexType = other.indexType;
+            quantization = other.quantization;
+            bounds = other.bounds;
+            boundingSphere = other.boundingSphere;
+            lods = std::move(other.lods);
+            samplerNames = std::move(other.samplerNames);
+            samplerProgram = other.samplerProgram;
+            samplerHandles = std::move(other.samplerHandles);
+            arena = other.arena;
+            range = other.range;
+            other.arena = nullptr;
+        }
+        return *this;
+    }
+
+    ~Mesh()
+    {
+        release();
+    }
+
+    // size of the vertex data as stored on the GPU
+    size_t GpuVertexBytes() const
+    {
+        return vertices.size() * (format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex));
+    }
+
+    // number of indices of all levels of detail together
+    size_t IndexCount() const
+    {
+        size_t count = indices.size();
+        for (const MeshLod& lod : lods)
+            count += lod.indices.size();
+        return count;
+    }
+
+    // size of the index data of all levels of detail as stored on the GPU
+    size_t GpuIndexBytes() const
+    {
+        return IndexCount() * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int));
+    }
+
+    // the levels of detail, counting the mesh itself
+    unsigned int LodCount() const
+    {
+        return 1 + static_cast<unsigned int>(lods.size());
+    }
+
+    // where a level of detail is in the arena; levels past the coarsest one give the coarsest
+    const GeometryRange& LodRange(unsigned int level) const
+    {
+        return level == 0 || lods.empty() ? range : lods[std::min<size_t>(level, lods.size()) - 1].range;
+    }
+
+    float LodError(unsigned int level) const
+    {
+        return level == 0 || lods.empty() ? 0.0f : lods[std::min<size_t>(level, lods.size()) - 1].error;
+    }
+
+    // binds the textures and the per-draw uniform block, everything but the geometry needed to draw the mesh.
+    // transform is the model matrix, unless drawing instanced
+    void BindMaterial(const Shader& shader, const glm::mat4& transform = glm::mat4(1.0f), bool instanced = false) const
+    {
+        // the uniform locations only have to be looked up again when drawing with a different shader
+        if (samplerProgram != shader.ID)
+            resolveUniforms(shader);
+
+        BindDrawUniforms(transform, instanced);
+
+        // bind appropriate textures, unless they're bound already
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            // set the sampler to the texture unit, and bind the texture to it
+            shader.setInt(samplerHandles[i], i);
+            GLStateCache::Instance().BindTexture(i, textures[i].id);
+        }
+    }
+
+    // binds just the per-draw uniform block: where to draw, and how the vertex shader turns the stored positions back
+    // into object space. Enough for depth-only passes, which sample no textures.
+    void BindDrawUniforms(const glm::mat4& transform = glm::mat4(1.0f), bool instanced = false) const
+    {
+        DrawUniforms draw = { transform, glm::vec4(quantization.offset, 0.0f), glm::vec4(quantization.scale, 0.0f), instanced ? 1 : 0, {} };
+        UniformRing::Instance().Bind(DRAW_UNIFORM_BINDING, draw);
+    }
+
+    // whether two meshes can be drawn together: same buffers, same textures and same position quantization
+    bool SharesStateWith(const Mesh& other) const
+    {
+        if (arena != other.arena || textures.size() != other.textures.size() || samplerNames != other.samplerNames)
+            return false;
+        if (quantization.offset != other.quantization.offset || quantization.scale != other.quantization.scale)
+            return false;
+        for (unsigned int i = 0; i < textures.size(); i++)
+            if (textures[i].id != other.textures[i].id)
+                return false;
+        return true;
+    }
+
     // render the mesh
-    void Draw(Shader& shader)
+    void Draw(const Shader& shader, const glm::mat4& transform = glm::mat4(1.0f)) const
+    {
+        PROFILE_ZONE("Mesh::Draw");
+        BindMaterial(shader, transform);
+
+        // draw mesh
+        arena->Bind();
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(range.indexCount), indexType, arena->indexOffset(range), static_cast<GLint>(range.firstVertex));
+        renderStats.drawCalls++;
+        renderStats.drawnMeshes++;
+        renderStats.triangles += range.indexCount / 3;
+
+        // always good practice to set everything back to defaults once configured.
+        GLStateCache::Instance().Reset();
+    }
+
+private:
+    // render data 
+    vector<string> samplerNames; // sampler uniform name for each texture, e.g. texture_diffuse1
+    mutable unsigned int samplerProgram = 0; // the shader program samplerHandles were resolved against
+    mutable vector<UniformHandle> samplerHandles;
+
+    // whether any vertex is influenced by a bone
+    bool hasBoneWeights() const
+    {
+        for (const Vertex& vertex : vertices)
+            for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+                if (vertex.m_Weights[i] != 0.0f)
+                    return true;
+        return false;
+    }
+
+    // names the sampler of every texture: the N-th texture of a type is bound to e.g. texture_diffuseN
+    void setupSamplers()
     {
-        // bind appropriate textures
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
+        samplerNames.clear();
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -78,69 +244,63 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to string
             else if (name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerNames.push_back(name + number);
         }
+        samplerHandles.assign(textures.size(), UniformHandle());
+        samplerProgram = 0;
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // looks up the handles of the sampler uniforms in the given shader's uniform table
+    void resolveUniforms(const Shader& shader) const
+    {
+        for (unsigned int i = 0; i < samplerNames.size(); i++)
+            samplerHandles[i] = shader.uniform(samplerNames[i]);
+        samplerProgram = shader.ID;
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
+    // gives the mesh's geometry back to the arena
+    void release()
+    {
+        if (arena)
+        {
+            arena->Free(range);
+            for (const MeshLod& lod : lods)
+                arena->Free(lod.range);
+        }
+        arena = nullptr;
+    }
 
-    // initializes all the buffer objects/arrays
+    // converts the vertices and indices to their GPU formats and copies them into the shared arena
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        // most meshes have fewer than 65536 vertices, and then half the index memory and bandwidth will do
+        indexType = vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        arena = &GeometryArena::For(format, indexType);
+
+        const void* vertexData = vertices.data();
+        vector<PackedVertex> packed;
+        if (format == VERTEX_FORMAT_PACKED)
+        {
+            packed.reserve(vertices.size());
+            for (const Vertex& vertex : vertices)
+                packed.push_back(PackVertex(vertex, quantization));
+            vertexData = packed.data();
+        }
+
+        vector<uint16_t> shortIndices;
+        range = arena->Allocate(vertexData, vertices.size(), indexData(indices, shortIndices), indices.size());
+        // the levels of detail index the same vertices
+        for (MeshLod& lod : lods)
+            lod.range = arena->AllocateIndices(range.firstVertex, indexData(lod.indices, shortIndices), lod.indices.size());
+    }
+
+    // the indices in the mesh's index type; shortIndices holds them if they have to be converted
+    const void* indexData(const vector<unsigned int>& source, vector<uint16_t>& shortIndices) const
+    {
+        if (indexType != GL_UNSIGNED_SHORT)
+            return source.data();
+        shortIndices.assign(source.begin(), source.end());
+        return shortIndices.data();
     }
 };
 #endif
\ No newline at end of file
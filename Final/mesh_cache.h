@@ -0,0 +1,273 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h"
+#include "mesh_optimizer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+using namespace std;
+
+// a binary mirror of what Model builds from ASSIMP, so warm startups can skip parsing entirely.
+// bump MESH_CACHE_VERSION whenever the Vertex layout or the file layout below changes.
+const uint32_t MESH_CACHE_MAGIC = 0x4843534D; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 4;
+
+// identifies the exact source asset and import settings a cache file was built from
+struct MeshCacheKey {
+    string   sourcePath;
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint32_t postProcessFlags;
+    uint32_t optimized; // whether the meshes went through OptimizeMesh after import
+};
+
+// a material binding as stored in the cache: the texture is resolved again on load
+struct CachedTexture {
+    string type;
+    string path;
+};
+
+// mesh data as imported, or restored from the cache, ready to be handed to the Mesh constructor
+struct CachedMesh {
+    vector<Vertex>        vertices;
+    vector<unsigned int>  indices;
+    vector<CachedTexture> textures;
+    vector<MeshLod>       lods;
+    MeshOptimizeStats     optimizeStats; // not cached: only a fresh import optimizes, and reports what it did
+};
+
+// the cache file lives next to its source asset
+inline string MeshCachePath(const string& sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+// fills in the key for a source file; returns false if the file can't be stat'ed.
+inline bool MeshCacheKeyFor(const string& sourcePath, uint32_t postProcessFlags, bool optimized, MeshCacheKey& key)
+{
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(sourcePath, ec);
+    if (ec)
+        return false;
+    auto time = std::filesystem::last_write_time(sourcePath, ec);
+    if (ec)
+        return false;
+
+    key.sourcePath = sourcePath;
+    key.sourceSize = static_cast<uint64_t>(size);
+    key.sourceTime = static_cast<int64_t>(time.time_since_epoch().count());
+    key.postProcessFlags = postProcessFlags;
+    key.optimized = optimized ? 1 : 0;
+    return true;
+}
+
+// bounds-checked cursor over the cache file once it has been read into memory
+class MeshCacheReader
+{
+public:
+    MeshCacheReader(const char* data, size_t size) : data(data), size(size), offset(0) {}
+
+    bool read(void* dst, size_t bytes)
+    {
+        if (bytes > size - offset)
+            return false;
+        if (bytes != 0)
+            memcpy(dst, data + offset, bytes);
+        offset += bytes;
+        return true;
+    }
+
+    template <typename T>
+    bool read(T& value)
+    {
+        return read(&value, sizeof(T));
+    }
+
+    bool read(string& value)
+    {
+        uint32_t length;
+        if (!read(length) || length > size - offset)
+            return false;
+        value.assign(data + offset, length);
+        offset += length;
+        return true;
+    }
+
+    // every stored element takes at least minBytes, so counts read from a corrupt file can be rejected early
+    bool fits(uint32_t count, size_t minBytes) const
+    {
+        return count <= (size - offset) / minBytes;
+    }
+
+    template <typename T>
+    bool read(vector<T>& values)
+    {
+        uint32_t count;
+        if (!read(count) || count > (size - offset) / sizeof(T))
+            return false;
+        values.resize(count);
+        return read(values.data(), count * sizeof(T));
+    }
+
+private:
+    const char* data;
+    size_t size;
+    size_t offset;
+};
+
+// little helpers for the writer side, mirroring MeshCacheReader
+template <typename T>
+inline void WriteMeshCacheValue(ofstream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void WriteMeshCacheValue(ofstream& out, const string& value)
+{
+    WriteMeshCacheValue(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+template <typename T>
+inline void WriteMeshCacheArray(ofstream& out, const vector<T>& values)
+{
+    WriteMeshCacheValue(out, static_cast<uint32_t>(values.size()));
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+// writes the imported meshes of a model to disk. The file is written to a temporary
+// name first and renamed into place, so an interrupted write never leaves a half-valid cache.
+inline bool WriteMeshCache(const MeshCacheKey& key, const vector<CachedMesh>& meshes)
+{
+    string cachePath = MeshCachePath(key.sourcePath);
+    string tempPath = cachePath + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+
+        WriteMeshCacheValue(out, MESH_CACHE_MAGIC);
+        WriteMeshCacheValue(out, MESH_CACHE_VERSION);
+        WriteMeshCacheValue(out, static_cast<uint32_t>(sizeof(Vertex)));
+        WriteMeshCacheValue(out, key.sourcePath);
+        WriteMeshCacheValue(out, key.sourceSize);
+        WriteMeshCacheValue(out, key.sourceTime);
+        WriteMeshCacheValue(out, key.postProcessFlags);
+        WriteMeshCacheValue(out, key.optimized);
+
+        WriteMeshCacheValue(out, static_cast<uint32_t>(meshes.size()));
+        for (const CachedMesh& mesh : meshes)
+        {
+            WriteMeshCacheArray(out, mesh.vertices);
+            WriteMeshCacheArray(out, mesh.indices);
+            WriteMeshCacheValue(out, static_cast<uint32_t>(mesh.textures.size()));
+            for (const CachedTexture& texture : mesh.textures)
+            {
+                WriteMeshCacheValue(out, texture.type);
+                WriteMeshCacheValue(out, texture.path);
+            }
+            WriteMeshCacheValue(out, static_cast<uint32_t>(mesh.lods.size()));
+            for (const MeshLod& lod : mesh.lods)
+            {
+                WriteMeshCacheValue(out, lod.error);
+                WriteMeshCacheArray(out, lod.indices);
+            }
+        }
+        if (!out)
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+// reads the cache for the given key with a single read of the whole file. Returns false
+// (leaving meshes empty) if there is no cache, or it was built from a different source or settings.
+inline bool ReadMeshCache(const MeshCacheKey& key, vector<CachedMesh>& meshes)
+{
+    meshes.clear();
+
+    ifstream in(MeshCachePath(key.sourcePath), ios::binary | ios::ate);
+    if (!in)
+        return false;
+    streamsize size = in.tellg();
+    if (size <= 0)
+        return false;
+    vector<char> buffer(static_cast<size_t>(size));
+    in.seekg(0);
+    if (!in.read(buffer.data(), size))
+        return false;
+
+    MeshCacheReader reader(buffer.data(), buffer.size());
+    uint32_t magic, version, vertexSize, postProcessFlags, optimized, meshCount;
+    string sourcePath;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!reader.read(magic) || magic != MESH_CACHE_MAGIC)
+        return false;
+    if (!reader.read(version) || version != MESH_CACHE_VERSION)
+        return false;
+    if (!reader.read(vertexSize) || vertexSize != sizeof(Vertex))
+        return false;
+    if (!reader.read(sourcePath) || sourcePath != key.sourcePath)
+        return false;
+    if (!reader.read(sourceSize) || sourceSize != key.sourceSize)
+        return false;
+    if (!reader.read(sourceTime) || sourceTime != key.sourceTime)
+        return false;
+    if (!reader.read(postProcessFlags) || postProcessFlags != key.postProcessFlags)
+        return false;
+    if (!reader.read(optimized) || optimized != key.optimized)
+        return false;
+    if (!reader.read(meshCount) || !reader.fits(meshCount, 4 * sizeof(uint32_t)))
+        return false;
+
+    meshes.resize(meshCount);
+    for (CachedMesh& mesh : meshes)
+    {
+        uint32_t textureCount;
+        if (!reader.read(mesh.vertices) || !reader.read(mesh.indices) || !reader.read(textureCount) || !reader.fits(textureCount, 2 * sizeof(uint32_t)))
+        {
+            meshes.clear();
+            return false;
+        }
+        mesh.textures.resize(textureCount);
+        for (CachedTexture& texture : mesh.textures)
+        {
+            if (!reader.read(texture.type) || !reader.read(texture.path))
+            {
+                meshes.clear();
+                return false;
+            }
+        }
+        uint32_t lodCount;
+        if (!reader.read(lodCount) || !reader.fits(lodCount, sizeof(float) + sizeof(uint32_t)))
+        {
+            meshes.clear();
+            return false;
+        }
+        mesh.lods.resize(lodCount);
+        for (MeshLod& lod : mesh.lods)
+        {
+            if (!reader.read(lod.error) || !reader.read(lod.indices))
+            {
+                meshes.clear();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,342 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// import-time index and vertex reordering so meshes render with fewer vertex shader invocations, less overdraw
+// and better vertex fetch locality. OptimizeMesh runs the whole pipeline:
+//   1. deduplicate identical vertices (ASSIMP emits one vertex per face corner for OBJ files)
+//   2. reorder triangles for the post-transform vertex cache (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+//   3. reorder clusters of those triangles front-to-back from the outside in, to reduce overdraw (as in Tipsify)
+//   4. renumber vertices in order of first use, for vertex fetch locality
+
+// vertex cache size assumed when optimizing and when reporting statistics
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// post-transform cache efficiency of an index buffer, simulated on a FIFO cache
+struct VertexCacheStats {
+    // average cache miss ratio: transformed vertices per triangle, 0.5 at best and 3 at worst
+    float acmr = 0.0f;
+    // average transform to vertex ratio: transformed vertices per vertex, 1 at best
+    float atvr = 0.0f;
+};
+
+inline VertexCacheStats AnalyzeVertexCache(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+
+    // timestamp of the moment each vertex entered the cache; it's in the cache while that's less than cacheSize misses ago
+    vector<size_t> cachedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (cachedAt[index] == 0 || misses - cachedAt[index] + 1 > cacheSize)
+        {
+            misses++;
+            cachedAt[index] = misses;
+        }
+    }
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(vertexCount);
+    return stats;
+}
+
+// merges bitwise identical vertices and rewrites the indices accordingly
+inline void DeduplicateVertices(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    struct VertexHash {
+        const vector<Vertex>* vertices;
+        size_t operator()(unsigned int index) const
+        {
+            // FNV-1a over the vertex bytes; Vertex has no padding, so identical vertices hash identically
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&(*vertices)[index]);
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(Vertex); i++)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            return static_cast<size_t>(hash);
+        }
+    };
+    struct VertexEqual {
+        const vector<Vertex>* vertices;
+        bool operator()(unsigned int a, unsigned int b) const
+        {
+            return memcmp(&(*vertices)[a], &(*vertices)[b], sizeof(Vertex)) == 0;
+        }
+    };
+
+    vector<Vertex> unique;
+    unique.reserve(vertices.size());
+    vector<unsigned int> remap(vertices.size());
+    unordered_map<unsigned int, unsigned int, VertexHash, VertexEqual> seen(vertices.size(), VertexHash{ &vertices }, VertexEqual{ &vertices });
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        auto it = seen.emplace(i, static_cast<unsigned int>(unique.size()));
+        if (it.second)
+            unique.push_back(vertices[i]);
+        remap[i] = it.first->second;
+    }
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(unique);
+}
+
+// Forsyth's vertex score: vertices just used or about to run out of triangles are preferred
+inline float ForsythVertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        // the last triangle's vertices get a fixed score, so the next triangle doesn't just reuse them
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / static_cast<float>(VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f * std::pow(static_cast<float>(remainingTriangles), -0.5f);
+}
+
+// reorders the triangles for post-transform vertex cache reuse
+inline void OptimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles adjacent to every vertex, in compressed rows
+    vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    vector<unsigned int> adjacency(indices.size());
+    vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[filled[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+    vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+    vector<bool> emitted(triangleCount, false);
+
+    vector<unsigned int> cache, newCache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    newCache.reserve(VERTEX_CACHE_SIZE + 3);
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    size_t scanCursor = 0; // every triangle before this one has been emitted
+    long long bestTriangle = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        // nothing in the cache connects to an unemitted triangle: continue with the next unemitted one
+        if (bestTriangle < 0)
+        {
+            while (emitted[scanCursor])
+                scanCursor++;
+            bestTriangle = static_cast<long long>(scanCursor);
+        }
+
+        size_t t = static_cast<size_t>(bestTriangle);
+        emitted[t] = true;
+        const unsigned int* corners = &indices[t * 3];
+        result.insert(result.end(), corners, corners + 3);
+
+        // the triangle's vertices move to the front of the cache, the rest shifts back
+        newCache.assign(corners, corners + 3);
+        for (unsigned int v : cache)
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                newCache.push_back(v);
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = corners[k];
+            // remove the triangle from its vertices' adjacency, so it isn't scored anymore
+            unsigned int* begin = &adjacency[firstTriangle[v]];
+            unsigned int* end = begin + remaining[v];
+            *std::find(begin, end, static_cast<unsigned int>(t)) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // rescore everything that was or still is cached, and pick the best triangle touching it
+        size_t cached = std::min<size_t>(newCache.size(), VERTEX_CACHE_SIZE);
+        for (size_t i = 0; i < newCache.size(); i++)
+            vertexScore[newCache[i]] = ForsythVertexScore(i < cached ? static_cast<int>(i) : -1, remaining[newCache[i]]);
+
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < newCache.size(); i++)
+        {
+            unsigned int v = newCache[i];
+            for (unsigned int j = 0; j < remaining[v]; j++)
+            {
+                unsigned int candidate = adjacency[firstTriangle[v] + j];
+                const unsigned int* c = &indices[candidate * 3];
+                float score = vertexScore[c[0]] + vertexScore[c[1]] + vertexScore[c[2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = candidate;
+                }
+            }
+        }
+
+        newCache.resize(cached);
+        cache.swap(newCache);
+    }
+    indices.swap(result);
+}
+
+// reorders clusters of cache-optimized triangles so that the outward facing ones on the outside of the mesh
+// are drawn first and occlude the rest. Clusters are split where the cache starts over (a triangle missing all
+// three vertices), so the cache efficiency of the previous step is preserved.
+inline void OptimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // find the cluster boundaries by simulating the cache again
+    vector<size_t> clusterStart;
+    vector<size_t> cachedAt(vertices.size(), 0);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (cachedAt[v] == 0 || misses - cachedAt[v] + 1 > VERTEX_CACHE_SIZE)
+            {
+                misses++;
+                cachedAt[v] = misses;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3)
+            clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+    size_t clusterCount = clusterStart.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    glm::vec3 meshCentroid(0.0f);
+    for (const Vertex& vertex : vertices)
+        meshCentroid += vertex.Position;
+    meshCentroid /= static_cast<float>(vertices.size());
+
+    // a cluster's occlusion potential: how far its area weighted centroid lies out along its average normal
+    vector<float> potential(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+        {
+            glm::vec3 p0 = vertices[indices[t * 3]].Position;
+            glm::vec3 p1 = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        if (area > 0.0f)
+            centroid /= area;
+        float length = glm::length(normal);
+        potential[c] = length > 0.0f ? glm::dot(centroid - meshCentroid, normal / length) : 0.0f;
+    }
+
+    vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return potential[a] > potential[b]; });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+    indices.swap(result);
+}
+
+// renumbers the vertices in the order the index buffer first uses them, dropping unreferenced ones
+inline void OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    const unsigned int unassigned = ~0u;
+    vector<unsigned int> remap(vertices.size(), unassigned);
+    vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == unassigned)
+        {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+// what OptimizeMesh did to a mesh; meshes are optimized on several threads at once, so the numbers are returned
+// rather than printed, see PrintMeshOptimizeStats
+struct MeshOptimizeStats {
+    bool optimized = false;
+    size_t triangles = 0;
+    size_t verticesBefore = 0, verticesAfter = 0;
+    VertexCacheStats before, after;
+};
+
+// runs the whole optimization pipeline on a triangle list and returns the cache statistics before and after
+inline MeshOptimizeStats OptimizeMesh(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    MeshOptimizeStats stats;
+    if (indices.size() < 3 || vertices.empty())
+        return stats;
+
+    stats.verticesBefore = vertices.size();
+    stats.before = AnalyzeVertexCache(indices, vertices.size());
+
+    DeduplicateVertices(vertices, indices);
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+
+    stats.after = AnalyzeVertexCache(indices, vertices.size());
+    stats.optimized = true;
+    stats.triangles = indices.size() / 3;
+    stats.verticesAfter = vertices.size();
+    return stats;
+}
+
+// prints the statistics of an optimized mesh as one line, written at once so lines of other threads can't break it
+inline void PrintMeshOptimizeStats(const MeshOptimizeStats& stats)
+{
+    if (!stats.optimized)
+        return;
+    ostringstream line;
+    line << "MESH::OPTIMIZE " << stats.triangles << " triangles, " << stats.verticesBefore << " -> " << stats.verticesAfter
+         << " vertices, ACMR " << stats.before.acmr << " -> " << stats.after.acmr << ", ATVR " << stats.before.atvr << " -> "
+         << stats.after.atvr << '\n';
+    cout << line.str() << flush;
+}
+#endif
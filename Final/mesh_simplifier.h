@@ -0,0 +1,380 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// import-time simplification for discrete levels of detail. SimplifyMesh collapses edges in order of their quadric
+// error (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics"), always onto the other vertex
+// of the edge, so the result is only a new index buffer over the mesh's own vertices. To keep the look intact:
+//   - vertices sharing their position with others that have different attributes (UV seams, hard normal edges)
+//     never move, so seams stay exactly where they are
+//   - vertices on an open border only move along it, and border edges add a plane that keeps the outline in place
+//   - collapses that flip a triangle, or join vertices whose normals point apart, are rejected
+
+// a symmetric 4x4 quadric (its 10 distinct coefficients) of area weighted planes, and the total weight, so the
+// error it measures is a mean squared distance
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+    double weight = 0;
+
+    // the plane dot(normal, p) + d = 0; normal must be unit length
+    static Quadric FromPlane(const glm::vec3& normal, float d, float planeWeight)
+    {
+        Quadric q;
+        double a = normal.x, b = normal.y, c = normal.z, w = planeWeight;
+        q.a00 = w * a * a; q.a01 = w * a * b; q.a02 = w * a * c; q.a03 = w * a * d;
+        q.a11 = w * b * b; q.a12 = w * b * c; q.a13 = w * b * d;
+        q.a22 = w * c * c; q.a23 = w * c * d;
+        q.a33 = w * d * d;
+        q.weight = w;
+        return q;
+    }
+
+    void Add(const Quadric& other)
+    {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+        a11 += other.a11; a12 += other.a12; a13 += other.a13;
+        a22 += other.a22; a23 += other.a23;
+        a33 += other.a33;
+        weight += other.weight;
+    }
+
+    // the weighted mean squared distance of p to the planes
+    double Error(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                     + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                     + a22 * z * z + 2 * a23 * z
+                     + a33;
+        return weight > 0 ? std::fabs(error) / weight : 0.0;
+    }
+};
+
+// how far a vertex may move
+enum SimplifyVertexKind {
+    SIMPLIFY_MANIFOLD, // anywhere along its edges
+    SIMPLIFY_BORDER,   // only along the open border it is on
+    SIMPLIFY_LOCKED    // not at all: on a seam, or where the surface isn't manifold
+};
+
+// border edges pull this much harder than faces, so outlines (e.g. of leaf cards) keep their shape
+const float SIMPLIFY_BORDER_WEIGHT = 10.0f;
+// vertices whose normals are further apart than about 60 degrees aren't joined
+const float SIMPLIFY_MIN_NORMAL_DOT = 0.5f;
+// border vertices where the border turns by more than about 20 degrees are corners, and don't move
+const float SIMPLIFY_MIN_BORDER_DOT = 0.94f;
+
+// no level of detail strays further from its mesh than this fraction of the mesh's radius
+const float LOD_MAX_RELATIVE_ERROR = 0.1f;
+
+// the first vertex at each vertex's position, so vertices split only by their attributes count as one
+inline vector<unsigned int> SimplifyPositionRemap(const vector<Vertex>& vertices)
+{
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const
+        {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+    unordered_map<glm::vec3, unsigned int, PositionHash> firstAt;
+    firstAt.reserve(vertices.size());
+    vector<unsigned int> remap(vertices.size());
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        remap[i] = firstAt.emplace(vertices[i].Position, i).first->second;
+    return remap;
+}
+
+// simplifies a triangle list towards targetIndexCount indices, moving no vertex further than maxError (in model
+// units, as the root of the quadric error) from the surface. Returns the new indices and sets error to how far the
+// result strays from the input; it can stay above the target when the limits don't allow more collapses.
+inline vector<unsigned int> SimplifyMesh(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount, float maxError, float& error)
+{
+    error = 0.0f;
+    vector<unsigned int> result = indices;
+    if (vertices.empty() || indices.size() <= targetIndexCount)
+        return result;
+    size_t vertexCount = vertices.size();
+    vector<unsigned int> positionOf = SimplifyPositionRemap(vertices);
+
+    // a position with several vertices is a seam
+    vector<unsigned int> verticesAt(vertexCount, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        verticesAt[positionOf[v]]++;
+
+    // the open and the non-manifold edges, between positions: an edge is open if no triangle runs it the other way
+    auto edgeKey = [](unsigned int from, unsigned int to) { return static_cast<uint64_t>(from) << 32 | to; };
+    unordered_map<uint64_t, unsigned int> edgeUses;
+    edgeUses.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3)
+        for (int e = 0; e < 3; e++)
+            edgeUses[edgeKey(positionOf[result[i + e]], positionOf[result[i + (e + 1) % 3]])]++;
+    unordered_set<uint64_t> borderEdges;
+    vector<SimplifyVertexKind> kind(vertexCount, SIMPLIFY_MANIFOLD);
+    for (const auto& edge : edgeUses)
+    {
+        unsigned int from = static_cast<unsigned int>(edge.first >> 32), to = static_cast<unsigned int>(edge.first);
+        auto opposite = edgeUses.find(edgeKey(to, from));
+        if (edge.second > 1 || (opposite != edgeUses.end() && opposite->second > 1))
+        {
+            kind[from] = kind[to] = SIMPLIFY_LOCKED;
+            continue;
+        }
+        if (opposite == edgeUses.end())
+        {
+            borderEdges.insert(edge.first);
+            for (unsigned int p : { from, to })
+                if (kind[p] == SIMPLIFY_MANIFOLD)
+                    kind[p] = SIMPLIFY_BORDER;
+        }
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        unsigned int p = positionOf[v];
+        if (verticesAt[p] > 1)
+            kind[p] = SIMPLIFY_LOCKED;
+        kind[v] = kind[p];
+    }
+    auto isBorderEdge = [&](unsigned int a, unsigned int b) {
+        return borderEdges.count(edgeKey(a, b)) || borderEdges.count(edgeKey(b, a));
+    };
+    // whether sliding a border vertex from its neighbour 'previous' on to 'next' keeps the border about straight, so
+    // corners stay put
+    auto continuesBorder = [&](unsigned int previous, unsigned int position, unsigned int next) {
+        if (previous == next || !isBorderEdge(previous, position))
+            return true;
+        glm::vec3 incoming = vertices[position].Position - vertices[previous].Position;
+        glm::vec3 outgoing = vertices[next].Position - vertices[position].Position;
+        return glm::dot(glm::normalize(incoming), glm::normalize(outgoing)) > SIMPLIFY_MIN_BORDER_DOT;
+    };
+
+    // the quadrics, per position: the planes of the triangles around it and of the border edges it is on
+    vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        const glm::vec3& p0 = vertices[result[i]].Position;
+        const glm::vec3& p1 = vertices[result[i + 1]].Position;
+        const glm::vec3& p2 = vertices[result[i + 2]].Position;
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float area = glm::length(normal);
+        if (area <= 0.0f)
+            continue;
+        normal /= area;
+        Quadric face = Quadric::FromPlane(normal, -glm::dot(normal, p0), area * 0.5f);
+        for (int e = 0; e < 3; e++)
+        {
+            unsigned int a = positionOf[result[i + e]], b = positionOf[result[i + (e + 1) % 3]];
+            quadrics[a].Add(face);
+            if (!borderEdges.count(edgeKey(a, b)))
+                continue;
+            // the plane through the border edge, perpendicular to the triangle
+            glm::vec3 edge = vertices[b].Position - vertices[a].Position;
+            float length = glm::length(edge);
+            if (length <= 0.0f)
+                continue;
+            glm::vec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+            Quadric border = Quadric::FromPlane(borderNormal, -glm::dot(borderNormal, vertices[a].Position), length * length * SIMPLIFY_BORDER_WEIGHT);
+            quadrics[a].Add(border);
+            quadrics[b].Add(border);
+        }
+    }
+
+    // every pass collapses a batch of the cheapest edges that don't touch each other's triangles, then drops the
+    // triangles that became degenerate; the triangles around each vertex are found again between passes
+    double maxErrorSquared = static_cast<double>(maxError) * maxError;
+    double worstError = 0.0;
+    vector<unsigned int> firstTriangle(vertexCount + 1), adjacency, collapseTo(vertexCount), bestTarget(vertexCount);
+    vector<double> bestCost(vertexCount);
+    vector<unsigned int> candidates;
+    vector<char> touched(vertexCount);
+    while (result.size() > targetIndexCount)
+    {
+        // the triangles around every vertex, in compressed rows
+        std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+        for (unsigned int index : result)
+            firstTriangle[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            firstTriangle[v + 1] += firstTriangle[v];
+        adjacency.resize(result.size());
+        vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+            adjacency[filled[result[i]]++] = static_cast<unsigned int>(i / 3);
+
+        // the cheapest allowed collapse of every vertex
+        std::fill(bestCost.begin(), bestCost.end(), -1.0);
+        for (size_t i = 0; i < result.size(); i += 3)
+            for (int c = 0; c < 3; c++)
+                for (int other = 1; other <= 2; other++)
+                {
+                    unsigned int from = result[i + c], to = result[i + (c + other) % 3];
+                    if (from == to || kind[from] == SIMPLIFY_LOCKED)
+                        continue;
+                    unsigned int fromPosition = positionOf[from], toPosition = positionOf[to];
+                    if (kind[from] == SIMPLIFY_BORDER && !isBorderEdge(fromPosition, toPosition))
+                        continue;
+                    const Vertex& a = vertices[from];
+                    const Vertex& b = vertices[to];
+                    if (glm::dot(a.Normal, a.Normal) > 0.0f && glm::dot(b.Normal, b.Normal) > 0.0f
+                        && glm::dot(glm::normalize(a.Normal), glm::normalize(b.Normal)) < SIMPLIFY_MIN_NORMAL_DOT)
+                        continue;
+                    Quadric combined = quadrics[fromPosition];
+                    combined.Add(quadrics[toPosition]);
+                    double cost = combined.Error(b.Position);
+                    if (bestCost[from] < 0.0 || cost < bestCost[from])
+                    {
+                        bestCost[from] = cost;
+                        bestTarget[from] = to;
+                    }
+                }
+        candidates.clear();
+        for (unsigned int v = 0; v < vertexCount; v++)
+            if (bestCost[v] >= 0.0 && bestCost[v] <= maxErrorSquared)
+                candidates.push_back(v);
+        std::sort(candidates.begin(), candidates.end(), [&](unsigned int a, unsigned int b) { return bestCost[a] < bestCost[b]; });
+
+        for (unsigned int v = 0; v < vertexCount; v++)
+            collapseTo[v] = v;
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t trianglesToRemove = (result.size() - targetIndexCount) / 3, removed = 0, collapses = 0;
+        for (unsigned int from : candidates)
+        {
+            if (removed >= trianglesToRemove && removed > 0)
+                break;
+            unsigned int to = bestTarget[from];
+            unsigned int fromPosition = positionOf[from], toPosition = positionOf[to];
+            if (touched[fromPosition] || touched[toPosition])
+                continue;
+
+            // the triangles around the vertex either contain the edge and disappear, or must keep their facing
+            bool valid = true;
+            size_t disappearing = 0;
+            for (unsigned int k = firstTriangle[from]; k < firstTriangle[from + 1] && valid; k++)
+            {
+                const unsigned int* triangle = &result[adjacency[k] * 3];
+                bool hasTarget = false;
+                glm::vec3 before[3], after[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int corner = triangle[c];
+                    if (positionOf[corner] == toPosition)
+                    {
+                        hasTarget = true;
+                        // the triangle would join the other side of a seam
+                        valid = valid && corner == to;
+                    }
+                    before[c] = vertices[corner].Position;
+                    after[c] = corner == from ? vertices[to].Position : before[c];
+                    // the other border edge of a border vertex must continue the one it slides along
+                    unsigned int position = positionOf[corner], next = positionOf[triangle[(c + 1) % 3]];
+                    if (kind[from] == SIMPLIFY_BORDER && position == fromPosition)
+                        valid = valid && continuesBorder(next, fromPosition, toPosition);
+                    if (kind[from] == SIMPLIFY_BORDER && next == fromPosition)
+                        valid = valid && continuesBorder(position, fromPosition, toPosition);
+                }
+                if (hasTarget)
+                {
+                    disappearing++;
+                    continue;
+                }
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                valid = valid && glm::dot(normalBefore, normalAfter) > 0.0f;
+            }
+            if (!valid)
+                continue;
+
+            collapseTo[from] = to;
+            quadrics[toPosition].Add(quadrics[fromPosition]);
+            // nothing else around here may change in this pass, or the checks above wouldn't hold; the border
+            // edges of the vertex now end at the target instead
+            for (unsigned int k = firstTriangle[from]; k < firstTriangle[from + 1]; k++)
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int a = positionOf[result[adjacency[k] * 3 + c]], b = positionOf[result[adjacency[k] * 3 + (c + 1) % 3]];
+                    touched[a] = 1;
+                    if (kind[from] == SIMPLIFY_BORDER && (a == fromPosition) != (b == fromPosition) && borderEdges.count(edgeKey(a, b)))
+                    {
+                        a = a == fromPosition ? toPosition : a;
+                        b = b == fromPosition ? toPosition : b;
+                        if (a != b)
+                            borderEdges.insert(edgeKey(a, b));
+                    }
+                }
+            removed += disappearing;
+            collapses++;
+            worstError = std::max(worstError, bestCost[from]);
+        }
+        if (collapses == 0)
+            break;
+
+        // apply the collapses, dropping the triangles that lost their area
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = collapseTo[result[i]], b = collapseTo[result[i + 1]], c = collapseTo[result[i + 2]];
+            if (positionOf[a] == positionOf[b] || positionOf[b] == positionOf[c] || positionOf[c] == positionOf[a])
+                continue;
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+    error = static_cast<float>(std::sqrt(worstError));
+    return result;
+}
+
+// the levels of detail of a mesh: up to maxLevels, each simplified from the one before to about half its
+// triangles and optimized for the vertex cache. Stops early once a level would save less than a tenth of the
+// triangles, or would have to move vertices further than maxError. Levels accumulate the error of the ones before.
+inline vector<MeshLod> GenerateLods(const vector<Vertex>& vertices, const vector<unsigned int>& indices, unsigned int maxLevels, float maxError)
+{
+    vector<MeshLod> lods;
+    const vector<unsigned int>* previous = &indices;
+    float previousError = 0.0f;
+    for (unsigned int level = 1; level <= maxLevels; level++)
+    {
+        size_t target = previous->size() / 6 * 3;
+        MeshLod lod;
+        float levelError;
+        lod.indices = SimplifyMesh(vertices, *previous, target, maxError - previousError, levelError);
+        if (lod.indices.empty() || lod.indices.size() > previous->size() * 9 / 10)
+            break;
+        OptimizeVertexCache(lod.indices, vertices.size());
+        lod.error = previousError + levelError;
+        previousError = lod.error;
+        lods.push_back(std::move(lod));
+        previous = &lods.back().indices;
+    }
+
+    return lods;
+}
+
+// prints the triangle counts and errors of a mesh's levels of detail as one line, written at once so lines of other
+// threads can't break it
+inline void PrintMeshLods(size_t triangles, const vector<MeshLod>& lods)
+{
+    ostringstream line;
+    line << "MESH::LOD " << triangles;
+    for (const MeshLod& lod : lods)
+        line << " -> " << lod.indices.size() / 3 << " (error " << lod.error << ")";
+    line << " triangles\n";
+    cout << line.str() << flush;
+}
+#endif
@@ -9,10 +9,21 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "gl_extensions.h"
+#include "job_system.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "profiler.h"
+#include "render_queue.h"
 #include "shader_m.h"
-#include "stb_image.h"
+#include "software_occlusion.h"
+#include "texture_loader.h"
+#include "texture_registry.h"
 
+#include <cfloat>
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -21,127 +32,504 @@
 #include <vector>
 using namespace std;
 
+// loads a texture through the TextureRegistry; the caller owns one reference and must Release it.
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+// the ASSIMP post-processing every model is imported with; part of the mesh cache key.
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// one draw of glMultiDrawElementsIndirect, laid out as the GL reads it from the indirect buffer
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// the CPU side of loading a model: its meshes as read from the mesh cache or imported with ASSIMP, with their
+// levels of detail, before anything is uploaded. Building one touches no GL state, so it can run on any thread (see
+// ModelStreamer); the Model constructor then does the GL part.
+struct ModelImport {
+    string path;
+    vector<CachedMesh> meshes;
+    PositionQuantization quantization; // of all meshes together, see Model
+    OccluderProxy occluder;            // see BuildOccluderProxy
+    bool optimized = false;
+    bool loadedFromCache = false;
+    bool valid = false;
+    double milliseconds = 0.0;
+};
+
 class Model
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// every texture reference this model holds in the TextureRegistry, which makes sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    bool optimizeMeshes; // reorder vertices and indices for the GPU at import, see mesh_optimizer.h
+    AABB bounds;         // of all meshes, in model space
+    BoundingSphere boundingSphere;
+    OccluderProxy occluder; // what SoftwareOcclusion draws when the model hides others; empty if no level is low-poly enough
+    // load statistics: whether the meshes came from the binary cache and how long loading took
+    bool loadedFromCache = false;
+    double loadMilliseconds = 0.0;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // textures are decoded in parallel before the constructor returns, unless a shared TextureLoader is passed
+    // in: then they're only queued, and become valid once the caller flushes the loader (e.g. after all models
+    // of the scene are constructed, so the whole scene decodes as one batch).
+    Model(string const& path, bool gamma = false, TextureLoader* textureLoader = nullptr, bool optimize = true)
+        : Model(Import(path, optimize), gamma, textureLoader)
     {
-        loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    // the GL part of loading a model that was imported already (see Import): uploads the meshes and acquires the
+    // textures, which the loader fills in as above.
+    Model(ModelImport imported, bool gamma = false, TextureLoader* textureLoader = nullptr) : gammaCorrection(gamma), optimizeMeshes(imported.optimized)
     {
-        for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        if (textureLoader)
+            build(imported, *textureLoader);
+        else
+        {
+            TextureLoader loader;
+            build(imported, loader);
+            loader.Flush();
+        }
     }
 
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const& path)
-    {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+    // reads a model with supported ASSIMP extensions from file, processing its meshes (see mesh_optimizer.h and
+    // mesh_simplifier.h) in parallel on the JobSystem, unless a valid binary mesh cache exists next to the file; in
+    // that case the cache is read instead, otherwise one is written after import. Touches no GL state.
+    static ModelImport Import(string const& path, bool optimize = true)
+    {
+        auto start = chrono::steady_clock::now();
+        ModelImport imported;
+        imported.path = path;
+        imported.optimized = optimize;
+
+        MeshCacheKey cacheKey;
+        bool cacheable = MeshCacheKeyFor(path, MODEL_IMPORT_FLAGS, optimize, cacheKey);
+        imported.loadedFromCache = cacheable && ReadMeshCache(cacheKey, imported.meshes);
+        if (!imported.loadedFromCache)
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+            // check for errors
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return imported;
+            }
+
+            // gather the meshes of all nodes, then process them all at once: each one is a job of its own
+            vector<const aiMesh*> sceneMeshes;
+            collectMeshes(scene->mRootNode, scene, sceneMeshes);
+            imported.meshes.resize(sceneMeshes.size());
+            JobSystem::Instance().ParallelFor(sceneMeshes.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                    imported.meshes[i] = processMesh(sceneMeshes[i], scene, optimize);
+            });
+            // the meshes' reports, in mesh order now that all are done
+            for (const CachedMesh& mesh : imported.meshes)
+            {
+                PrintMeshOptimizeStats(mesh.optimizeStats);
+                PrintMeshLods(mesh.indices.size() / 3, mesh.lods);
+            }
+
+            if (cacheable && !WriteMeshCache(cacheKey, imported.meshes))
+                cout << "WARNING::MESH_CACHE:: could not write cache for " << path << endl;
+        }
+
+        // packed positions of all meshes are quantized to the bounds of every vertex in the model
+        glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+        for (const CachedMesh& mesh : imported.meshes)
+            for (const Vertex& vertex : mesh.vertices)
+            {
+                minimum = glm::min(minimum, vertex.Position);
+                maximum = glm::max(maximum, vertex.Position);
+            }
+        if (minimum.x <= maximum.x)
+            imported.quantization = QuantizationForBounds(minimum, maximum);
+        imported.occluder = BuildOccluderProxy(imported.meshes);
+        imported.valid = true;
+        imported.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return imported;
+    }
+
+    // a model owns its meshes and textures, so it can be moved but never copied.
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&&) = default;
+    Model& operator=(Model&&) = delete;
+
+    ~Model()
+    {
+        for (const Texture& texture : textures_loaded)
+            TextureRegistry::Instance().Release(texture.id);
+    }
+
+    // total number of vertices and indices over all meshes, and the GPU memory they take up
+    size_t VertexCount() const
+    {
+        size_t count = 0;
+        for (const Mesh& mesh : meshes)
+            count += mesh.vertices.size();
+        return count;
+    }
+    size_t IndexCount() const
+    {
+        size_t count = 0;
+        for (const Mesh& mesh : meshes)
+            count += mesh.IndexCount();
+        return count;
+    }
+    size_t GpuVertexBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.GpuVertexBytes();
+        return bytes;
+    }
+    size_t GpuIndexBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.GpuIndexBytes();
+        return bytes;
+    }
+
+    // the levels of detail of the model, counting the full one: as many as its most detailed mesh has
+    unsigned int LodCount() const
+    {
+        return static_cast<unsigned int>(batches.size());
+    }
+
+    // how far a level of detail strays from the full model at most, in model units; levels past the coarsest one
+    // give the coarsest
+    float LodError(unsigned int level) const
+    {
+        return lodErrors.empty() ? 0.0f : lodErrors[std::min<size_t>(level, lodErrors.size() - 1)];
+    }
+
+    // draws the model, and thus all its meshes, at a level of detail (0 is the full model) with the given model matrix
+    // meshes sharing buffers and material are submitted together, so this takes one VAO bind and one
+    // multi-draw per material rather than a bind and draw per mesh.
+    void Draw(const Shader& shader, unsigned int lod = 0, const glm::mat4& transform = glm::mat4(1.0f)) const
+    {
+        PROFILE_ZONE("Model::Draw");
+        for (const DrawBatch& batch : lodBatches(lod))
+        {
+            const Mesh& material = meshes[batch.materialMesh];
+            material.BindMaterial(shader, transform);
+            material.arena->Bind();
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), material.indexType, batch.offsets.data(),
+                                          static_cast<GLsizei>(batch.counts.size()), batch.baseVertices.data());
+            renderStats.drawCalls++;
+            renderStats.drawnMeshes += batch.counts.size();
+            renderStats.triangles += batch.triangles;
         }
+
+        // always good practice to set everything back to defaults once configured.
+        GLStateCache::Instance().Reset();
+    }
+
+    // draws instanceCount copies of the model with one call per mesh, each with its own model matrix taken from
+    // instanceBuffer (tightly packed glm::mat4, starting at firstInstance). The shader reads the matrix from the
+    // attribute at INSTANCE_MATRIX_LOCATION.
+    void DrawInstanced(const Shader& shader, unsigned int instanceBuffer, size_t firstInstance, size_t instanceCount, unsigned int lod = 0) const
+    {
+        PROFILE_ZONE("Model::DrawInstanced");
+        if (instanceCount == 0)
+            return;
+        for (size_t batch = 0; batch < lodBatches(lod).size(); batch++)
+            DrawBatchInstanced(shader, instanceBuffer, firstInstance, instanceCount, lod, batch);
+
+        // always good practice to set everything back to defaults once configured.
+        GLStateCache::Instance().Reset();
+    }
+
+    // the batches of a level of detail one by one, for a RenderQueue to sort: how many there are, the state each
+    // needs, and drawing one as DrawInstanced would. DrawBatchInstanced leaves its state bound.
+    size_t BatchCount(unsigned int lod) const
+    {
+        return lodBatches(lod).size();
+    }
+
+    uint32_t BatchMaterial(unsigned int lod, size_t batch) const
+    {
+        return lodBatches(lod)[batch].material;
+    }
+
+    unsigned int BatchVertexArray(unsigned int lod, size_t batch) const
+    {
+        return meshes[lodBatches(lod)[batch].materialMesh].arena->VertexArray();
+    }
+
+    void DrawBatchInstanced(const Shader& shader, unsigned int instanceBuffer, size_t firstInstance, size_t instanceCount, unsigned int lod, size_t index) const
+    {
+        const DrawBatch& batch = lodBatches(lod)[index];
+        const Mesh& material = meshes[batch.materialMesh];
+        material.BindMaterial(shader, glm::mat4(1.0f), true);
+        drawBatchInstances(batch, instanceBuffer, firstInstance, instanceCount);
+    }
+
+    // draws a batch like DrawBatchInstanced, with whatever program is in use, but binds no textures and sets no
+    // sampler uniforms: for depth-only passes such as the Hi-Z occluders. Leaves its state bound.
+    void DrawBatchDepthInstanced(unsigned int instanceBuffer, size_t firstInstance, size_t instanceCount, unsigned int lod, size_t index) const
+    {
+        const DrawBatch& batch = lodBatches(lod)[index];
+        meshes[batch.materialMesh].BindDrawUniforms(glm::mat4(1.0f), true);
+        drawBatchInstances(batch, instanceBuffer, firstInstance, instanceCount);
+    }
+
+    // the indirect commands of a batch, one per mesh, with no instances yet: whoever culls fills in instanceCount.
+    // Instances are read from baseInstance on.
+    void AppendBatchCommands(unsigned int lod, size_t index, GLuint baseInstance, vector<DrawElementsIndirectCommand>& commands) const
+    {
+        const DrawBatch& batch = lodBatches(lod)[index];
+        size_t indexSize = meshes[batch.materialMesh].arena->indexSize();
+        for (size_t i = 0; i < batch.counts.size(); i++)
+            commands.push_back({ static_cast<GLuint>(batch.counts[i]), 0,
+                                 static_cast<GLuint>(reinterpret_cast<size_t>(batch.offsets[i]) / indexSize),
+                                 batch.baseVertices[i], baseInstance });
+    }
+
+    // draws a batch from the commands AppendBatchCommands made for it, at byte offset indirect in the bound
+    // GL_DRAW_INDIRECT_BUFFER, in one call. Needs glExtensions.computeAndIndirect; leaves its state bound.
+    void DrawBatchIndirect(const Shader& shader, unsigned int instanceBuffer, unsigned int lod, size_t index, size_t indirect) const
+    {
+        const DrawBatch& batch = lodBatches(lod)[index];
+        const Mesh& material = meshes[batch.materialMesh];
+        material.BindMaterial(shader, glm::mat4(1.0f), true);
+        material.arena->Bind();
+        EnableInstanceAttributes(instanceBuffer, 0);
+        glExtensions.multiDrawElementsIndirect(GL_TRIANGLES, material.indexType, reinterpret_cast<const void*>(indirect),
+                                               static_cast<GLsizei>(batch.counts.size()), 0);
+        DisableInstanceAttributes();
+        renderStats.drawCalls++;
+    }
+
+private:
+    // the ranges of all meshes that can be drawn with one glMultiDrawElementsBaseVertex
+    struct DrawBatch {
+        size_t materialMesh; // the first mesh of the batch, which sets up buffers and textures for all of them
+        vector<GLsizei> counts;
+        vector<const void*> offsets;
+        vector<GLint> baseVertices;
+        size_t triangles = 0;
+        uint32_t material = 0; // the id of its texture set, see MaterialIdFor
+    };
+    vector<vector<DrawBatch>> batches; // per level of detail
+    vector<float> lodErrors;           // the worst error of any mesh, per level of detail
+    // packed positions of all meshes are quantized to the bounds of the whole model, so they can share a batch
+    PositionQuantization quantization;
+
+    // where texture loads are queued while the model is being loaded
+    TextureLoader* textureLoader = nullptr;
+
+    // uploads the imported meshes and acquires their textures
+    void build(ModelImport& imported, TextureLoader& loader)
+    {
+        textureLoader = &loader;
+        auto start = chrono::steady_clock::now();
+
         // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        directory = imported.path.substr(0, imported.path.find_last_of('/'));
+        loadedFromCache = imported.loadedFromCache;
+        quantization = imported.quantization;
+        occluder = std::move(imported.occluder);
+
+        meshes.reserve(imported.meshes.size());
+        for (CachedMesh& mesh : imported.meshes)
+        {
+            vector<Texture> textures;
+            for (const CachedTexture& texture : mesh.textures)
+                textures.push_back(loadTexture(texture.path.c_str(), texture.type));
+            meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices), std::move(textures), &quantization, std::move(mesh.lods)));
+        }
+        imported.meshes.clear();
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        buildBatches();
+        computeBounds();
+
+        double buildMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        loadMilliseconds = imported.milliseconds + buildMilliseconds;
+        cout << "MODEL::LOAD " << imported.path << " " << (loadedFromCache ? "warm (mesh cache)" : "cold (assimp)")
+             << " " << meshes.size() << " meshes in " << loadMilliseconds << " ms (" << buildMilliseconds << " ms on the GL thread)" << endl;
+
+        cout << "MODEL::VERTICES " << VertexCount() << " vertices, " << GpuVertexBytes() << " bytes on the GPU ("
+             << VertexCount() * sizeof(Vertex) << " unpacked)" << endl;
+        cout << "MODEL::INDICES " << IndexCount() << " indices, " << GpuIndexBytes() << " bytes on the GPU ("
+             << IndexCount() * sizeof(unsigned int) << " as 32-bit)" << endl;
+        cout << "MODEL::OCCLUDER " << occluder.Triangles() << " proxy triangles, " << occluder.positions.size() << " vertices" << endl;
+        textureLoader = nullptr;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // the model's bounds, from those of its meshes
+    void computeBounds()
     {
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        bounds = AABB();
+        for (const Mesh& mesh : meshes)
+            bounds.Extend(mesh.bounds);
+        boundingSphere = BoundingSphere();
+        if (bounds.Empty())
+            return;
+        boundingSphere.center = bounds.Center();
+        boundingSphere.radius = 0.0f;
+        for (const Mesh& mesh : meshes)
+            if (mesh.boundingSphere.radius >= 0.0f)
+                boundingSphere.radius = std::max(boundingSphere.radius, glm::length(mesh.boundingSphere.center - boundingSphere.center) + mesh.boundingSphere.radius);
+    }
+
+    // the batches of a level of detail; levels past the coarsest one give the coarsest
+    const vector<DrawBatch>& lodBatches(unsigned int lod) const
+    {
+        static const vector<DrawBatch> none;
+        return batches.empty() ? none : batches[std::min<size_t>(lod, batches.size() - 1)];
+    }
+
+    // draws the instances of a batch whose uniforms are bound
+    void drawBatchInstances(const DrawBatch& batch, unsigned int instanceBuffer, size_t firstInstance, size_t instanceCount) const
+    {
+        const Mesh& material = meshes[batch.materialMesh];
+        material.arena->Bind();
+        EnableInstanceAttributes(instanceBuffer, firstInstance);
+        // there's no instanced multi-draw before GL 4.x, so the meshes of a batch are drawn one by one
+        for (size_t i = 0; i < batch.counts.size(); i++)
         {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batch.counts[i], material.indexType, batch.offsets[i],
+                                              static_cast<GLsizei>(instanceCount), batch.baseVertices[i]);
+            renderStats.drawCalls++;
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
+        DisableInstanceAttributes();
+        renderStats.drawnMeshes += batch.counts.size() * instanceCount;
+        renderStats.triangles += batch.triangles * instanceCount;
+    }
+
+    // groups the meshes into draw batches of meshes that share buffers, textures and quantization, for every level
+    // of detail. Meshes with fewer levels than others are drawn at their coarsest one in the levels past it.
+    void buildBatches()
+    {
+        unsigned int lodCount = 0;
+        for (const Mesh& mesh : meshes)
+            lodCount = std::max(lodCount, mesh.LodCount());
+        batches.assign(lodCount, vector<DrawBatch>());
+        lodErrors.assign(lodCount, 0.0f);
+        for (unsigned int lod = 0; lod < lodCount; lod++)
+        {
+            buildBatches(lod, batches[lod]);
+            for (const Mesh& mesh : meshes)
+                lodErrors[lod] = std::max(lodErrors[lod], mesh.LodError(lod));
+        }
+    }
+
+    void buildBatches(unsigned int lod, vector<DrawBatch>& levelBatches)
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
         {
-            processNode(node->mChildren[i], scene);
+            const Mesh& mesh = meshes[i];
+            const GeometryRange& range = mesh.LodRange(lod);
+            if (range.indexCount == 0)
+                continue;
+            DrawBatch* batch = nullptr;
+            for (DrawBatch& candidate : levelBatches)
+                if (meshes[candidate.materialMesh].SharesStateWith(mesh))
+                {
+                    batch = &candidate;
+                    break;
+                }
+            if (!batch)
+            {
+                levelBatches.push_back(DrawBatch());
+                batch = &levelBatches.back();
+                batch->materialMesh = i;
+                vector<unsigned int> textureIds;
+                for (const Texture& texture : mesh.textures)
+                    textureIds.push_back(texture.id);
+                batch->material = MaterialIdFor(textureIds);
+            }
+            batch->counts.push_back(static_cast<GLsizei>(range.indexCount));
+            batch->offsets.push_back(mesh.arena->indexOffset(range));
+            batch->baseVertices.push_back(static_cast<GLint>(range.firstVertex));
+            batch->triangles += range.indexCount / 3;
         }
+    }
 
+    // lists the meshes of a node and then those of its children, recursively, in the order the mesh cache keeps them
+    static void collectMeshes(const aiNode* node, const aiScene* scene, vector<const aiMesh*>& meshes)
+    {
+        // the node object only contains indices to index the actual objects in the scene. 
+        // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+            meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            collectMeshes(node->mChildren[i], scene, meshes);
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // copies one vertex attribute of all vertices from ASSIMP's array of it
+    static void copyAttribute(const aiVector3D* source, vector<Vertex>& vertices, glm::vec3 Vertex::*attribute)
+    {
+        for (size_t i = 0; i < vertices.size(); i++)
+            vertices[i].*attribute = glm::vec3(source[i].x, source[i].y, source[i].z);
+    }
+
+    // converts a mesh to engine vertices and indices, optimizes it and generates its levels of detail. Only reads
+    // the scene, so meshes can be processed on several threads at once.
+    static CachedMesh processMesh(const aiMesh* mesh, const aiScene* scene, bool optimize)
     {
         // data to fill
         vector<Vertex> vertices;
         vector<unsigned int> indices;
-        vector<Texture> textures;
+        vector<CachedTexture> textures;
 
-        // walk through each of the mesh's vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        // all vertices at once, then attribute by attribute: ASSIMP keeps each attribute in an array of its own.
+        // Attributes the mesh doesn't have stay zero, and no bone influences lets the packed vertex format be used.
+        Vertex blank = {};
+        for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            blank.m_BoneIDs[j] = -1;
+        vertices.assign(mesh->mNumVertices, blank);
+        copyAttribute(mesh->mVertices, vertices, &Vertex::Position);
+        if (mesh->HasNormals())
+            copyAttribute(mesh->mNormals, vertices, &Vertex::Normal);
+        // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+        // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+        if (mesh->mTextureCoords[0])
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
-            // texture coordinates
-            if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            const aiVector3D* texCoords = mesh->mTextureCoords[0];
+            for (size_t i = 0; i < vertices.size(); i++)
+                vertices[i].TexCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
+            if (mesh->mTangents && mesh->mBitangents)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                copyAttribute(mesh->mTangents, vertices, &Vertex::Tangent);
+                copyAttribute(mesh->mBitangents, vertices, &Vertex::Bitangent);
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        // the faces' indices; after triangulation almost every face is a triangle
+        indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            const aiFace& face = mesh->mFaces[i];
+            indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
         }
+        // reorder the triangles and vertices for the GPU, and simplify the levels of detail from the result; the
+        // mesh cache stores both
+        MeshOptimizeStats optimizeStats;
+        if (optimize)
+            optimizeStats = OptimizeMesh(vertices, indices);
+        vector<MeshLod> lods;
+        {
+            PROFILE_ZONE("Model::GenerateLods");
+            AABB meshBounds;
+            for (const Vertex& vertex : vertices)
+                meshBounds.Extend(vertex.Position);
+            float radius = meshBounds.Empty() ? 0.0f : glm::length(meshBounds.Extents());
+            lods = GenerateLods(vertices, indices, MAX_LOD_LEVELS - 1, radius * LOD_MAX_RELATIVE_ERROR);
+        }
+
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -152,53 +540,46 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        materialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        materialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        materialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data; the textures are loaded once the mesh is built (see build)
+        CachedMesh result;
+        result.vertices = std::move(vertices);
+        result.indices = std::move(indices);
+        result.textures = std::move(textures);
+        result.lods = std::move(lods);
+        result.optimizeStats = optimizeStats;
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // appends the paths of all material textures of a given type
+    static void materialTextures(aiMaterial* mat, aiTextureType type, const string& typeName, vector<CachedTexture>& textures)
     {
-        vector<Texture> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(CachedTexture{ typeName, str.C_Str() });
         }
-        return textures;
+    }
+
+    // returns the texture for the given path relative to the model directory. The registry shares it with every
+    // other mesh and model using the same file, so it is only loaded the first time.
+    Texture loadTexture(const char* path, const string& typeName)
+    {
+        Texture texture;
+        // only diffuse maps hold colors; the mips of normal, specular and height maps are filtered as plain data
+        texture.id = TextureRegistry::Instance().Acquire(this->directory + '/' + string(path), gammaCorrection, textureLoader, typeName == "texture_diffuse");
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // remember the reference, so it is released together with the model.
+        return texture;
     }
 };
 
@@ -208,38 +589,6 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::Instance().Acquire(filename, gamma);
 }
 #endif
\ No newline at end of file
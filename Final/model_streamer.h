@@ -0,0 +1,211 @@
+#ifndef MODEL_STREAMER_H
+#define MODEL_STREAMER_H
+
+#include "job_system.h"
+#include "model.h"
+#include "texture_loader.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// loads models without stalling the render loop. A worker thread does everything that needs no GL context: reading
+// the mesh cache or importing with assimp, building the vertex data, and preparing the textures. It takes every
+// request waiting for it at once and works on them in parallel on the JobSystem. The GL thread only uploads, a bit
+// at a time from Update, so a frame never spends more than its budget on loading.
+// A model is drawable as soon as its meshes are uploaded; its textures show a placeholder texel (see
+// TextureLoader) until they arrive too.
+class ModelStreamer
+{
+public:
+    // a model being streamed in, shared between the caller and the streamer
+    class Request
+    {
+    public:
+        const string path;
+
+        // the model once its meshes are on the GPU, null before that or if it failed to load.
+        // only valid on the GL thread.
+        const Model* Get() const
+        {
+            return model.get();
+        }
+        // whether the model and all its textures are loaded, or loading failed
+        bool Done() const
+        {
+            Stage current = stage;
+            return current == DONE || current == FAILED;
+        }
+        bool Failed() const
+        {
+            return stage == FAILED;
+        }
+
+        Request(const string& path, bool gamma, bool optimize) : path(path), stage(IMPORTING), gamma(gamma), optimize(optimize) {}
+
+    private:
+        friend class ModelStreamer;
+        enum Stage { IMPORTING, UPLOADING_MESHES, PREPARING_TEXTURES, UPLOADING_TEXTURES, DONE, FAILED };
+        atomic<Stage> stage;
+        bool gamma, optimize;
+        ModelImport imported;     // filled in by the worker, consumed when the meshes are uploaded
+        unique_ptr<Model> model;  // created and destroyed on the GL thread only
+        TextureLoader textures;
+    };
+
+    ModelStreamer() : stopping(false), busy(0)
+    {
+        worker = thread(&ModelStreamer::work, this);
+    }
+
+    // waits for the worker to finish its current step. Requests still in flight are released here, so the GL
+    // objects of their models are freed on the calling thread, which must be the GL thread.
+    ~ModelStreamer()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wakeWorker.notify_one();
+        worker.join();
+        workerQueue.clear();
+        uploadQueue.clear();
+    }
+
+    ModelStreamer(const ModelStreamer&) = delete;
+    ModelStreamer& operator=(const ModelStreamer&) = delete;
+
+    // starts loading a model in the background and returns right away
+    shared_ptr<Request> Load(const string& path, bool gamma = false, bool optimize = true)
+    {
+        shared_ptr<Request> request = make_shared<Request>(path, gamma, optimize);
+        busy++;
+        toWorker(request);
+        return request;
+    }
+
+    // does the GL side of loading: uploads what the worker has finished, one model's meshes or one texture at a
+    // time, until the budget is used up. Always makes at least one step, so loading progresses even when frames are
+    // slow. Call it once per frame on the GL thread.
+    void Update(double budgetMilliseconds)
+    {
+        auto start = chrono::steady_clock::now();
+        do
+        {
+            shared_ptr<Request> request;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if (uploadQueue.empty())
+                    return;
+                request = uploadQueue.front();
+                uploadQueue.pop_front();
+            }
+            upload(request);
+        } while (chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() < budgetMilliseconds);
+    }
+
+    // the number of requests not done yet
+    size_t Busy() const
+    {
+        return busy;
+    }
+
+private:
+    thread worker;
+    mutex queueMutex;
+    condition_variable wakeWorker;
+    deque<shared_ptr<Request>> workerQueue; // waiting for the worker thread
+    deque<shared_ptr<Request>> uploadQueue; // waiting for the GL thread
+    bool stopping;
+    atomic<size_t> busy;
+
+    void toWorker(const shared_ptr<Request>& request)
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            workerQueue.push_back(request);
+        }
+        wakeWorker.notify_one();
+    }
+
+    // the worker never drops the last reference to a request: a model must be destroyed on the GL thread, so
+    // finished steps always go back through the upload queue, each as soon as it is done.
+    void work()
+    {
+        vector<shared_ptr<Request>> batch;
+        for (;;)
+        {
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wakeWorker.wait(lock, [this]() { return stopping || !workerQueue.empty(); });
+                if (stopping)
+                    return;
+                batch.assign(workerQueue.begin(), workerQueue.end());
+                workerQueue.clear();
+            }
+
+            JobSystem::Instance().ParallelFor(batch.size(), 1, [this, &batch](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    shared_ptr<Request>& request = batch[i];
+                    if (request->stage == Request::IMPORTING)
+                    {
+                        request->imported = Model::Import(request->path, request->optimize);
+                        request->stage = request->imported.valid ? Request::UPLOADING_MESHES : Request::FAILED;
+                    }
+                    else if (request->stage == Request::PREPARING_TEXTURES)
+                    {
+                        request->textures.Prepare();
+                        request->stage = Request::UPLOADING_TEXTURES;
+                    }
+
+                    lock_guard<mutex> lock(queueMutex);
+                    uploadQueue.push_back(std::move(request));
+                }
+            });
+            batch.clear();
+        }
+    }
+
+    void upload(const shared_ptr<Request>& request)
+    {
+        switch (request->stage)
+        {
+        case Request::UPLOADING_MESHES:
+            request->model.reset(new Model(std::move(request->imported), request->gamma, &request->textures));
+            request->imported = ModelImport();
+            if (request->textures.Pending() > 0)
+            {
+                request->stage = Request::PREPARING_TEXTURES;
+                toWorker(request);
+                return;
+            }
+            break;
+        case Request::UPLOADING_TEXTURES:
+            request->textures.UploadNext();
+            if (request->textures.Pending() > 0)
+            {
+                lock_guard<mutex> lock(queueMutex);
+                uploadQueue.push_front(request);
+                return;
+            }
+            break;
+        case Request::FAILED:
+            cout << "ERROR::STREAMER:: could not load " << request->path << endl;
+            busy--;
+            return;
+        default:
+            return;
+        }
+        request->stage = Request::DONE;
+        busy--;
+    }
+};
+#endif
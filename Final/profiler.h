@@ -0,0 +1,288 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// frame profiler. Zones are marked with PROFILE_ZONE("name") and last until the end of the enclosing scope; each
+// one records its CPU time and, through a pair of GL timestamp queries, its GPU time. Queries are read back a few
+// frames later so the CPU never waits on the GPU. Per zone, the time per frame is aggregated into percentiles and
+// the zones of every frame can be exported as a Chrome trace (chrome://tracing, Perfetto).
+// Zone names must be string literals: they are told apart by address.
+//
+// Only zones on the thread that enabled the profiler (the one with the GL context) are recorded; zones in code that
+// also runs on loader threads (see ModelStreamer) are ignored there.
+// While the profiler isn't enabled a zone costs one pointer test. Defining PROFILER_DISABLED removes zones
+// from the build altogether.
+#ifdef PROFILER_DISABLED
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE_CONCAT_(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_ZONE_CONCAT(profileZone, __LINE__)(name)
+#endif
+
+class Profiler
+{
+public:
+    // the enabled profiler, or null; this is all a zone looks at while profiling is off
+    inline static Profiler* active = nullptr;
+
+    static Profiler& Instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // starts profiling; needs the GL context to be current. Zones of every frame are kept for WriteChromeTrace if
+    // keepTrace is set.
+    void Enable(bool keepTrace = false)
+    {
+        traceEnabled = keepTrace;
+        origin = chrono::steady_clock::now();
+        owner = this_thread::get_id();
+        active = this;
+    }
+
+    // stops profiling, reads back what is still in flight and deletes the queries. Must run before the GL
+    // context is destroyed.
+    void Disable()
+    {
+        if (!active)
+            return;
+        // oldest frame first
+        for (size_t i = 0; i < FRAME_LATENCY; i++)
+            resolve(slots[(frameIndex + i) % FRAME_LATENCY]);
+        for (FrameSlot& slot : slots)
+        {
+            if (!slot.queries.empty())
+                glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+            slot.queries.clear();
+        }
+        active = nullptr;
+    }
+
+    // brackets a frame; every frame is a zone of its own, named "frame". Does nothing while not enabled.
+    void BeginFrame()
+    {
+        if (active != this)
+            return;
+        FrameSlot& slot = slots[frameIndex % FRAME_LATENCY];
+        // this slot's queries were issued FRAME_LATENCY frames ago, so they're (nearly always) done by now
+        resolve(slot);
+        slot.zones.clear();
+        slot.frame = frameIndex;
+        // relates GPU timestamps to the CPU clock, to show both on one timeline in the trace
+        GLint64 gpuNow;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        slot.gpuToCpuMicroseconds = cpuMicroseconds() - static_cast<double>(gpuNow) / 1000.0;
+        inFrame = true;
+        frameZone = BeginZone("frame");
+    }
+
+    void EndFrame()
+    {
+        if (active != this || !inFrame)
+            return;
+        EndZone(frameZone);
+        slots[frameIndex % FRAME_LATENCY].pending = true;
+        inFrame = false;
+        frameIndex++;
+    }
+
+    // use PROFILE_ZONE rather than calling these directly
+    int BeginZone(const char* name)
+    {
+        if (this_thread::get_id() != owner || !inFrame)
+            return -1;
+        FrameSlot& slot = slots[frameIndex % FRAME_LATENCY];
+        size_t index = slot.zones.size();
+        if (slot.queries.size() < (index + 1) * 2)
+        {
+            size_t oldSize = slot.queries.size();
+            slot.queries.resize(std::max<size_t>((index + 1) * 2, oldSize * 2));
+            glGenQueries(static_cast<GLsizei>(slot.queries.size() - oldSize), &slot.queries[oldSize]);
+        }
+        Zone zone;
+        zone.name = name;
+        zone.cpuBegin = cpuMicroseconds();
+        slot.zones.push_back(zone);
+        glQueryCounter(slot.queries[index * 2], GL_TIMESTAMP);
+        return static_cast<int>(index);
+    }
+
+    void EndZone(int index)
+    {
+        if (index < 0 || !inFrame)
+            return;
+        FrameSlot& slot = slots[frameIndex % FRAME_LATENCY];
+        glQueryCounter(slot.queries[index * 2 + 1], GL_TIMESTAMP);
+        slot.zones[index].cpuEnd = cpuMicroseconds();
+    }
+
+    // prints, per zone, how often it ran per frame and the percentiles of its CPU and GPU time per frame
+    void Report() const
+    {
+        for (const ZoneStats& stats : zoneStats)
+        {
+            cout << "PROFILER::ZONE " << stats.name << ", " << static_cast<double>(stats.calls) / static_cast<double>(std::max<size_t>(stats.cpuMilliseconds.size(), 1)) << " calls per frame" << endl;
+            FrameStatistics::Compute(stats.cpuMilliseconds).Print("    CPU");
+            FrameStatistics::Compute(stats.gpuMilliseconds).Print("    GPU");
+        }
+    }
+
+    // writes every recorded zone as a Chrome trace event file: CPU zones on one track and GPU zones on another
+    bool WriteChromeTrace(const string& filename) const
+    {
+        ofstream file(filename);
+        if (!file)
+        {
+            cout << "ERROR::PROFILER::CANNOT_WRITE_TRACE " << filename << endl;
+            return false;
+        }
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        file.precision(3);
+        file << fixed;
+        for (const TraceEvent& event : trace)
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.gpu ? 2 : 1)
+                 << ",\"ts\":" << event.begin << ",\"dur\":" << event.duration << ",\"args\":{\"frame\":" << event.frame << "}}";
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    // frames in flight before their queries are read back
+    static const size_t FRAME_LATENCY = 4;
+
+    struct Zone {
+        const char* name;
+        double cpuBegin = 0.0, cpuEnd = 0.0; // microseconds since Enable
+    };
+    // the zones of one frame and the timestamp queries behind them, two per zone
+    struct FrameSlot {
+        vector<Zone> zones;
+        vector<GLuint> queries;
+        size_t frame = 0;
+        double gpuToCpuMicroseconds = 0.0;
+        bool pending = false;
+    };
+    struct ZoneStats {
+        const char* name;
+        size_t calls = 0;
+        vector<double> cpuMilliseconds, gpuMilliseconds; // per frame in which the zone ran
+        double frameCpu = 0.0, frameGpu = 0.0;            // totals of the frame being resolved
+        bool inFrame = false;
+    };
+    struct TraceEvent {
+        const char* name;
+        bool gpu;
+        size_t frame;
+        double begin, duration; // microseconds
+    };
+
+    FrameSlot slots[FRAME_LATENCY];
+    size_t frameIndex = 0;
+    bool inFrame = false;
+    int frameZone = -1;
+    bool traceEnabled = false;
+    thread::id owner; // the thread zones are recorded on
+    chrono::steady_clock::time_point origin;
+    vector<ZoneStats> zoneStats;                   // in order of first appearance
+    unordered_map<const char*, size_t> zoneLookup; // index into zoneStats by name
+    vector<TraceEvent> trace;
+    vector<size_t> touched; // zones seen in the frame being resolved
+
+    Profiler() = default;
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    double cpuMicroseconds() const
+    {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - origin).count();
+    }
+
+    // reads back a finished frame's GPU times and adds the frame to the statistics and the trace
+    void resolve(FrameSlot& slot)
+    {
+        if (!slot.pending)
+            return;
+        slot.pending = false;
+
+        touched.clear();
+        for (size_t i = 0; i < slot.zones.size(); i++)
+        {
+            const Zone& zone = slot.zones[i];
+            GLuint64 gpuBegin = 0, gpuEnd = 0;
+            glGetQueryObjectui64v(slot.queries[i * 2], GL_QUERY_RESULT, &gpuBegin);
+            glGetQueryObjectui64v(slot.queries[i * 2 + 1], GL_QUERY_RESULT, &gpuEnd);
+            double gpuMicroseconds = static_cast<double>(gpuEnd - gpuBegin) / 1000.0;
+
+            auto lookup = zoneLookup.find(zone.name);
+            if (lookup == zoneLookup.end())
+            {
+                lookup = zoneLookup.emplace(zone.name, zoneStats.size()).first;
+                zoneStats.push_back(ZoneStats());
+                zoneStats.back().name = zone.name;
+            }
+            ZoneStats& stats = zoneStats[lookup->second];
+            if (!stats.inFrame)
+            {
+                stats.inFrame = true;
+                stats.frameCpu = stats.frameGpu = 0.0;
+                touched.push_back(lookup->second);
+            }
+            stats.calls++;
+            stats.frameCpu += (zone.cpuEnd - zone.cpuBegin) / 1000.0;
+            stats.frameGpu += gpuMicroseconds / 1000.0;
+
+            if (traceEnabled)
+            {
+                trace.push_back({ zone.name, false, slot.frame, zone.cpuBegin, zone.cpuEnd - zone.cpuBegin });
+                trace.push_back({ zone.name, true, slot.frame, static_cast<double>(gpuBegin) / 1000.0 + slot.gpuToCpuMicroseconds, gpuMicroseconds });
+            }
+        }
+        for (size_t index : touched)
+        {
+            ZoneStats& stats = zoneStats[index];
+            stats.cpuMilliseconds.push_back(stats.frameCpu);
+            stats.gpuMilliseconds.push_back(stats.frameGpu);
+            stats.inFrame = false;
+        }
+    }
+};
+
+// marks a zone from construction to destruction; see PROFILE_ZONE
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) : index(Profiler::active ? Profiler::active->BeginZone(name) : -1)
+    {
+    }
+
+    ~ProfileZone()
+    {
+        if (index >= 0)
+            Profiler::active->EndZone(index);
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    int index;
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+using namespace std;
+
+// a draw's sort key: the state it needs, most expensive to change first, so sorting by key groups draws that share
+// state. From the top bit down:
+//   pass         4 bits  e.g. opaque before transparent
+//   shader       8 bits
+//   material    20 bits  the set of textures, see MaterialIdFor
+//   vertex array 12 bits
+//   depth       20 bits  distance from the eye, nearest first, so draws that share all state go front to back
+const unsigned int RENDER_KEY_PASS_SHIFT = 60;
+const unsigned int RENDER_KEY_SHADER_SHIFT = 52;
+const unsigned int RENDER_KEY_MATERIAL_SHIFT = 32;
+const unsigned int RENDER_KEY_VERTEX_ARRAY_SHIFT = 20;
+const uint64_t RENDER_KEY_DEPTH_MASK = 0xFFFFF;
+
+enum RenderPass { RENDER_PASS_OPAQUE = 0 };
+
+// the depth field for a distance. The bits of a non-negative float sort like the float itself, so its top bits
+// make a key without having to know the depth range.
+inline uint64_t RenderDepthKey(float distance)
+{
+    if (!(distance > 0.0f))
+        return 0;
+    uint32_t bits;
+    memcpy(&bits, &distance, sizeof(bits));
+    return (bits >> 11) & RENDER_KEY_DEPTH_MASK;
+}
+
+// fields wider than their place in the key are wrapped; that only costs some state changes, never correctness
+inline uint64_t MakeRenderKey(RenderPass pass, uint32_t shader, uint32_t material, uint32_t vertexArray, float distance)
+{
+    return (uint64_t(pass) & 0xF) << RENDER_KEY_PASS_SHIFT
+         | (uint64_t(shader) & 0xFF) << RENDER_KEY_SHADER_SHIFT
+         | (uint64_t(material) & 0xFFFFF) << RENDER_KEY_MATERIAL_SHIFT
+         | (uint64_t(vertexArray) & 0xFFF) << RENDER_KEY_VERTEX_ARRAY_SHIFT
+         | RenderDepthKey(distance);
+}
+
+// a small number for each distinct set of texture names, in order of first use, so meshes with the same textures
+// sort next to each other. Must run on the GL thread, like all model building.
+inline uint32_t MaterialIdFor(const vector<unsigned int>& textures)
+{
+    static map<vector<unsigned int>, uint32_t> ids;
+    auto it = ids.emplace(textures, static_cast<uint32_t>(ids.size())).first;
+    return it->second;
+}
+
+// the draws of a frame, as sort keys with the index of the draw they stand for. Sorted with an LSD radix sort,
+// a byte at a time, skipping the bytes every key agrees on (mostly pass and shader). Both buffers keep their
+// capacity from frame to frame, so a steady scene queues without allocating.
+class RenderQueue
+{
+public:
+    struct Item {
+        uint64_t key;
+        uint32_t draw;
+    };
+
+    void Clear()
+    {
+        items.clear();
+    }
+
+    void Push(uint64_t key, uint32_t draw)
+    {
+        items.push_back({ key, draw });
+    }
+
+    size_t Size() const
+    {
+        return items.size();
+    }
+
+    // sorts by key; draws with equal keys keep the order they were pushed in
+    const vector<Item>& Sort()
+    {
+        if (items.size() < 2)
+            return items;
+        uint64_t differing = 0;
+        for (const Item& item : items)
+            differing |= item.key ^ items[0].key;
+        scratch.resize(items.size());
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            if (((differing >> shift) & 0xFF) == 0)
+                continue;
+            size_t offsets[256] = {};
+            for (const Item& item : items)
+                offsets[(item.key >> shift) & 0xFF]++;
+            size_t total = 0;
+            for (size_t& offset : offsets)
+            {
+                size_t count = offset;
+                offset = total;
+                total += count;
+            }
+            for (const Item& item : items)
+                scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+            items.swap(scratch);
+        }
+        return items;
+    }
+
+private:
+    vector<Item> items;
+    vector<Item> scratch;
+};
+#endif
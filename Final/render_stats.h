@@ -0,0 +1,31 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <cstddef>
+
+// counts of the GL work submitted for drawing. Nothing resets them on its own: whoever measures (e.g. the
+// benchmark, once per frame) clears them first.
+struct RenderStats {
+    size_t drawCalls = 0;        // glDrawElements* and glMultiDrawElements* calls
+    size_t drawnMeshes = 0;      // meshes drawn by those calls; one multi-draw draws several
+    size_t triangles = 0;
+    size_t shaderBinds = 0;
+    size_t vertexArrayBinds = 0;
+    size_t textureBinds = 0;
+    size_t skippedBinds = 0;     // binds the GLStateCache skipped because the state was bound already
+    size_t submittedObjects = 0; // scene objects that passed frustum culling and were drawn
+    size_t culledObjects = 0;    // scene objects frustum culling rejected
+    size_t occludedObjects = 0;  // scene objects inside the frustum but hidden behind the occluders, see HiZBuffer
+    size_t simplifiedObjects = 0; // submitted objects drawn at a coarser level of detail than the full model
+    size_t uniformBlocks = 0;    // uniform blocks written to the uniform ring and bound, see uniform_ring.h
+
+    // the binds between draw calls; uniform blocks aren't counted
+    size_t StateChanges() const
+    {
+        return shaderBinds + vertexArrayBinds + textureBinds;
+    }
+};
+
+// the counters everything adds to
+inline RenderStats renderStats;
+#endif
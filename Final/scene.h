@@ -0,0 +1,644 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "bvh.h"
+#include "gl_state.h"
+#include "gpu_culling.h"
+#include "hiz.h"
+#include "job_system.h"
+#include "model.h"
+#include "render_queue.h"
+#include "shader_m.h"
+#include "software_occlusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// the depth pre-pass of occlusion culling draws the objects covering the most of the screen, up to MAX_OCCLUDERS of
+// them, as long as they cover at least OCCLUDER_MIN_SCREEN_AREA of it (by their bounding boxes)
+const size_t MAX_OCCLUDERS = 32;
+const float OCCLUDER_MIN_SCREEN_AREA = 0.01f;
+// per frame work over every object runs on the JobSystem in chunks of at least this many objects
+const size_t SCENE_JOB_GRAIN = 1024;
+
+// a model placed in the world. It only refers to the model, so any number of objects can share one.
+struct SceneObject {
+    const Model* model;
+    glm::mat4 transform;
+};
+
+// picks a level of detail per object from the projected size of its error: the coarsest level that strays from
+// the full model by at most maxPixelError pixels on screen.
+struct LodSelector {
+    glm::vec3 eye = glm::vec3(0.0f);
+    float pixelsPerUnit = 0.0f; // how many pixels one world unit covers at distance 1
+    float maxPixelError = 1.0f;
+
+    // for a perspective projection (like the one built from Camera::Zoom) and a viewport viewportHeight pixels high
+    static LodSelector For(const glm::mat4& projection, const glm::mat4& view, float viewportHeight)
+    {
+        LodSelector selector;
+        selector.eye = glm::vec3(glm::inverse(view)[3]);
+        // projection[1][1] is 1 / tan(fovy / 2): at distance d the viewport is 2 d / projection[1][1] units high
+        selector.pixelsPerUnit = viewportHeight * 0.5f * projection[1][1];
+        return selector;
+    }
+
+    // the level for a model placed with the given world space sphere; errorScale is how much its transform scales
+    // the model (see MaxScale). The distance is taken to the nearest point of the sphere, so no part of the object
+    // ends up coarser than it should.
+    unsigned int Select(const Model& model, const BoundingSphere& sphere, float errorScale) const
+    {
+        float distance = glm::length(sphere.center - eye) - sphere.radius;
+        if (distance <= 0.0f)
+            return 0;
+        float maxError = maxPixelError * distance / (pixelsPerUnit * errorScale);
+        for (unsigned int level = model.LodCount() - 1; level > 0; level--)
+            if (model.LodError(level) <= maxError)
+                return level;
+        return 0;
+    }
+};
+
+// everything that gets drawn each frame. The scene is built once up front and then only read by the
+// render loop, so submitting it doesn't copy models or allocate any memory.
+// All objects placed with the same model are drawn together with hardware instancing: their transforms live in
+// one instance buffer, grouped by model, and each model is drawn once for all of its objects. Given a frustum,
+// objects whose bounding box lies outside it are culled first, through a BVH over the objects, and only the visible
+// ones are uploaded. Given a LodSelector, each model is then drawn once per level of detail its objects need.
+// The same hierarchy answers picking queries. Given an OcclusionView, the biggest objects on screen are drawn into
+// a HiZBuffer first, and objects hidden behind them are culled as well; with UseSoftwareOcclusion their occluder
+// proxies are rasterized on the CPU instead (see SoftwareOcclusion). On a GL 4.3 context, UseGpuCulling moves culling
+// and level of detail selection to the GPU instead (see GpuCulling).
+class Scene
+{
+public:
+    vector<SceneObject> objects;
+
+    Scene() = default;
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    ~Scene()
+    {
+        if (instanceVBO)
+            glDeleteBuffers(1, &instanceVBO);
+        if (occluderVBO)
+            glDeleteBuffers(1, &occluderVBO);
+    }
+
+    // places a model in the scene; the model must outlive the scene.
+    void Add(const Model& model, const glm::mat4& transform = glm::mat4(1.0f))
+    {
+        objects.push_back({ &model, transform });
+    }
+
+    // moves an object. Its instance and bounds are updated right away if the instances are built already, and the
+    // hierarchy is refitted, not rebuilt, once before the next draw or pick.
+    void SetTransform(size_t object, const glm::mat4& transform)
+    {
+        objects[object].transform = transform;
+        if (instancedObjects != objects.size())
+            return;
+        size_t instance = instanceOf[object];
+        transforms[instance] = transform;
+        spheres[instance] = objects[object].model->boundingSphere.Transformed(transform);
+        errorScales[instance] = MaxScale(transform);
+        boxes[instance] = objects[object].model->bounds.Transformed(transform);
+        hierarchy.Update(static_cast<uint32_t>(instance), boxes[instance]);
+        refitPending = true;
+        allVisible = false;
+        if (gpuCulling && !gpuInstancesStale)
+            gpuCulling->UpdateInstance(instance, transform, spheres[instance], boxes[instance], errorScales[instance]);
+    }
+
+    // culls and picks levels of detail on the GPU from now on. Returns false, leaving the scene on the CPU route,
+    // if the context can't run it.
+    bool UseGpuCulling()
+    {
+        unique_ptr<GpuCulling> culling(new GpuCulling());
+        if (!culling->Create())
+        {
+            cout << "SCENE::GPU_CULLING unavailable, culling on the CPU" << endl;
+            return false;
+        }
+        gpuCulling = std::move(culling);
+        gpuInstancesStale = true;
+        return true;
+    }
+
+    bool GpuCullingEnabled() const
+    {
+        return gpuCulling != nullptr;
+    }
+
+    // tests objects against the occluders' proxies rasterized on the CPU from now on, rather than against a HiZBuffer
+    // read back from the GPU. GpuCulling keeps testing against the HiZBuffer, which it has on the GPU already.
+    void UseSoftwareOcclusion()
+    {
+        softwareOcclusion.reset(new SoftwareOcclusion());
+        cout << "SCENE::SOFTWARE_OCCLUSION " << SOFTWARE_OCCLUSION_WIDTH << "x" << SOFTWARE_OCCLUSION_HEIGHT << " depth buffer, "
+             << OCCLUSION_SIMD_NAME << ", " << softwareOcclusion->Threads() << " threads" << endl;
+    }
+
+    // the object nearest along the ray origin + t * direction, for t up to distance: whichever mesh bounding box
+    // the ray enters first, so an object is hit through the gaps of its meshes but not those between its meshes.
+    // Sets object and distance (in units of direction) on a hit.
+    bool Pick(const glm::vec3& origin, const glm::vec3& direction, size_t& object, float& distance) const
+    {
+        PROFILE_ZONE("Scene::Pick");
+        prepareHierarchy();
+        uint32_t instance;
+        bool hit = hierarchy.Raycast(origin, direction, distance, instance, [&](uint32_t candidate, float maxDistance) {
+            // in model space the meshes' own boxes apply; the ray's t stays the same there as long as the direction
+            // isn't renormalized
+            glm::mat4 toModel = glm::inverse(transforms[candidate]);
+            glm::vec3 modelOrigin = glm::vec3(toModel * glm::vec4(origin, 1.0f));
+            glm::vec3 inverseDirection = 1.0f / glm::vec3(toModel * glm::vec4(direction, 0.0f));
+            float nearest = -1.0f;
+            for (const Mesh& mesh : objectModel(candidate)->meshes)
+            {
+                float meshDistance;
+                if (RayIntersectsBox(mesh.bounds, modelOrigin, inverseDirection, maxDistance, meshDistance))
+                {
+                    nearest = meshDistance;
+                    maxDistance = meshDistance;
+                }
+            }
+            return nearest;
+        });
+        if (hit)
+            object = objectOf[instance];
+        return hit;
+    }
+
+    // GPU geometry memory of all models in the scene (each model counted once, however often it is placed), and
+    // what it would take with full-float vertices and 32-bit indices
+    struct Memory {
+        size_t models = 0;
+        size_t vertexBytes = 0, indexBytes = 0;
+        size_t fullVertexBytes = 0, fullIndexBytes = 0;
+    };
+
+    Memory GpuMemory() const
+    {
+        Memory memory;
+        unordered_set<const Model*> counted;
+        for (const SceneObject& object : objects)
+        {
+            if (!counted.insert(object.model).second)
+                continue;
+            memory.vertexBytes += object.model->GpuVertexBytes();
+            memory.indexBytes += object.model->GpuIndexBytes();
+            memory.fullVertexBytes += object.model->VertexCount() * sizeof(Vertex);
+            memory.fullIndexBytes += object.model->IndexCount() * sizeof(unsigned int);
+        }
+        memory.models = counted.size();
+        return memory;
+    }
+
+    void ReportMemory() const
+    {
+        Memory memory = GpuMemory();
+        cout << "SCENE::MEMORY " << memory.models << " models: vertices " << memory.vertexBytes << " bytes (saved "
+             << memory.fullVertexBytes - memory.vertexBytes << "), indices " << memory.indexBytes << " bytes (saved "
+             << memory.fullIndexBytes - memory.indexBytes << ")" << endl;
+    }
+
+    // draws every object with its own model matrix, one instanced draw per model, level of detail and batch. With
+    // a frustum (in world space, see Frustum::FromMatrix) only the objects inside it are drawn, and with a
+    // LodSelector objects are drawn at the level it picks rather than in full detail.
+    // The draws go through a RenderQueue sorted by the state they need, and bind through the GLStateCache, so
+    // draws sharing textures or buffers follow each other and skip those binds. Given the eye position, draws that
+    // share all state go front to back. With an OcclusionView, objects hidden behind the biggest ones on screen are
+    // skipped too (see HiZBuffer and SoftwareOcclusion). With UseGpuCulling on, GpuCulling does all of this instead.
+    void Draw(const Shader& shader, const Frustum* frustum = nullptr, const LodSelector* lod = nullptr, const glm::vec3* eye = nullptr,
+              const OcclusionView* occlusion = nullptr) const
+    {
+        prepareHierarchy();
+        const HiZBuffer* occluders = nullptr;
+        const SoftwareOcclusion* rasterized = nullptr;
+        if (occlusion && softwareOcclusion && !gpuCulling)
+            rasterized = rasterizeOccluders(*occlusion, frustum);
+        else if (occlusion)
+            occluders = drawOccluders(*occlusion, frustum);
+        if (gpuCulling)
+        {
+            drawGpuCulled(shader, frustum, lod, occluders);
+            return;
+        }
+        if (frustum || lod || occluders || rasterized)
+            pack(frustum, lod, occluders, rasterized);
+        else
+        {
+            if (!allVisible)
+                showAll();
+            renderStats.submittedObjects += transforms.size();
+        }
+
+        queueDraws(shader, eye);
+        GLStateCache& state = GLStateCache::Instance();
+        state.Invalidate();
+        state.UseProgram(shader.ID);
+        for (const RenderQueue::Item& item : queue.Sort())
+        {
+            const QueuedDraw& draw = queued[item.draw];
+            draw.model->DrawBatchInstanced(shader, instanceVBO, draw.firstInstance, draw.instanceCount, draw.lod, draw.batch);
+        }
+        state.Reset();
+    }
+
+private:
+    // the objects of one model: consecutive in transforms, and their visible ones consecutive in the instance buffer,
+    // ordered by level of detail
+    struct InstanceGroup {
+        const Model* model;
+        size_t firstInstance;
+        size_t instanceCount;
+        size_t lodFirst[MAX_LOD_LEVELS] = {};
+        size_t lodCount[MAX_LOD_LEVELS] = {};
+    };
+    // built on the first draw after objects were added
+    mutable vector<InstanceGroup> groups;
+    mutable vector<glm::mat4> transforms;      // of all objects, grouped by model
+    mutable vector<size_t> instanceOf;         // where each object is in transforms
+    mutable vector<size_t> objectOf;           // and the other way round
+    mutable vector<BoundingSphere> spheres;    // of all objects in world space, in the order of transforms
+    mutable vector<float> errorScales;         // and how much their transforms scale
+    mutable vector<AABB> boxes;                // and their world space boxes
+    mutable BVH hierarchy;                     // over the world space boxes of the instances; primitive i is transforms[i]
+    mutable bool refitPending = false;         // objects moved since the hierarchy was last refitted
+    mutable unsigned int instanceVBO = 0;
+    mutable size_t instancedObjects = 0;
+    // per frame culling results; sized once, so culling doesn't allocate
+    static constexpr uint8_t OCCLUDED = 0xFF;
+    mutable vector<uint8_t> visible;           // per instance: 0 if culled, OCCLUDED if hidden, else 1 + its level of detail
+    mutable vector<glm::mat4> visibleTransforms;
+    mutable bool allVisible = false;           // the instance buffer holds every object, as uploaded by showAll
+    // the frame's draws, one per model, level and batch with any objects, in the order the queue sorts them into
+    struct QueuedDraw {
+        const Model* model;
+        unsigned int lod;
+        size_t batch;
+        size_t firstInstance;
+        size_t instanceCount;
+    };
+    mutable vector<QueuedDraw> queued;
+    mutable RenderQueue queue;
+    // set by UseGpuCulling; the instances are uploaded to it again after objects were added
+    unique_ptr<GpuCulling> gpuCulling;
+    mutable bool gpuInstancesStale = true;
+    // occlusion culling, set up on the first draw that asks for it
+    struct Occluder {
+        float area; // of the screen its box covers
+        uint32_t instance;
+    };
+    mutable unique_ptr<HiZBuffer> hiZ;
+    mutable vector<Occluder> occluders;
+    mutable vector<glm::mat4> occluderTransforms;
+    mutable unsigned int occluderVBO = 0;
+    // set by UseSoftwareOcclusion
+    unique_ptr<SoftwareOcclusion> softwareOcclusion;
+    mutable vector<OccluderDraw> occluderDraws;
+
+    // builds the instances and the hierarchy if objects were added, and brings the hierarchy up to date if any moved
+    void prepareHierarchy() const
+    {
+        if (instancedObjects != objects.size())
+            buildInstances();
+        if (refitPending)
+        {
+            PROFILE_ZONE("Scene::refit");
+            hierarchy.Refit();
+            refitPending = false;
+        }
+    }
+
+    const Model* objectModel(size_t instance) const
+    {
+        return objects[objectOf[instance]].model;
+    }
+
+    // groups the objects by model and builds the hierarchy over their world space boxes
+    void buildInstances() const
+    {
+        groups.clear();
+        unordered_map<const Model*, size_t> groupOf;
+        for (const SceneObject& object : objects)
+        {
+            auto it = groupOf.emplace(object.model, groups.size()).first;
+            if (it->second == groups.size())
+                groups.push_back({ object.model, 0, 0 });
+            groups[it->second].instanceCount++;
+        }
+        size_t first = 0;
+        for (InstanceGroup& group : groups)
+        {
+            group.firstInstance = first;
+            first += group.instanceCount;
+        }
+
+        transforms.assign(objects.size(), glm::mat4(1.0f));
+        spheres.resize(objects.size());
+        errorScales.resize(objects.size());
+        instanceOf.resize(objects.size());
+        objectOf.resize(objects.size());
+        boxes.resize(objects.size());
+        vector<size_t> filled(groups.size(), 0);
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            const SceneObject& object = objects[i];
+            size_t index = groupOf[object.model];
+            size_t instance = groups[index].firstInstance + filled[index]++;
+            transforms[instance] = object.transform;
+            instanceOf[i] = instance;
+            objectOf[instance] = i;
+        }
+        JobSystem::Instance().ParallelFor(objects.size(), SCENE_JOB_GRAIN, [this](size_t begin, size_t end) {
+            for (size_t instance = begin; instance < end; instance++)
+            {
+                const Model& model = *objectModel(instance);
+                spheres[instance] = model.boundingSphere.Transformed(transforms[instance]);
+                errorScales[instance] = MaxScale(transforms[instance]);
+                boxes[instance] = model.bounds.Transformed(transforms[instance]);
+            }
+        });
+        {
+            PROFILE_ZONE("Scene::buildHierarchy");
+            auto start = chrono::steady_clock::now();
+            hierarchy.Build(boxes);
+            cout << "SCENE::HIERARCHY " << objects.size() << " objects: " << hierarchy.nodes.size() << " nodes, depth "
+                 << hierarchy.depth << ", built in " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+        }
+        refitPending = false;
+        visible.assign(objects.size(), 0);
+        visibleTransforms.resize(objects.size());
+
+        if (!instanceVBO)
+            glGenBuffers(1, &instanceVBO);
+        instancedObjects = objects.size();
+        allVisible = false;
+        gpuInstancesStale = true;
+    }
+
+    void drawGpuCulled(const Shader& shader, const Frustum* frustum, const LodSelector* lod, const HiZBuffer* occluders) const
+    {
+        if (gpuInstancesStale)
+        {
+            vector<pair<const Model*, size_t>> counts;
+            for (const InstanceGroup& group : groups)
+                counts.push_back({ group.model, group.instanceCount });
+            gpuCulling->SetInstances(counts, transforms, spheres, boxes, errorScales);
+            gpuInstancesStale = false;
+        }
+        LodSelector full;
+        const LodSelector& selector = lod ? *lod : full;
+        gpuCulling->Draw(shader, frustum, occluders, lod != nullptr, selector.eye, selector.pixelsPerUnit, selector.maxPixelError);
+    }
+
+    // picks the frame's occluders: the objects covering the most of the screen, up to MAX_OCCLUDERS of them, in
+    // instance order. With proxies, only objects whose model has an occluder proxy count, and only as many of the
+    // biggest as fit in SOFTWARE_OCCLUSION_MAX_TRIANGLES.
+    void selectOccluders(const OcclusionView& view, const Frustum* frustum, bool proxies) const
+    {
+        occluders.clear();
+        auto consider = [this, &view, proxies](uint32_t instance) {
+            if (proxies && objectModel(instance)->occluder.Empty())
+                return;
+            ScreenRect rect;
+            // a box reaching behind the eye is around it, or nearly: as big an occluder as there is
+            float area = ProjectBox(boxes[instance], view.viewProjection, rect) ? rect.Area() : 1.0f;
+            if (area >= OCCLUDER_MIN_SCREEN_AREA)
+                occluders.push_back({ area, instance });
+        };
+        if (frustum)
+            hierarchy.Cull(*frustum, consider);
+        else
+            for (uint32_t instance = 0; instance < boxes.size(); instance++)
+                consider(instance);
+        auto bigger = [](const Occluder& a, const Occluder& b) { return a.area > b.area; };
+        if (occluders.size() > MAX_OCCLUDERS)
+        {
+            std::nth_element(occluders.begin(), occluders.begin() + MAX_OCCLUDERS, occluders.end(), bigger);
+            occluders.resize(MAX_OCCLUDERS);
+        }
+        if (proxies)
+        {
+            std::sort(occluders.begin(), occluders.end(), bigger);
+            size_t triangles = 0, count = 0;
+            for (; count < occluders.size(); count++)
+            {
+                triangles += objectModel(occluders[count].instance)->occluder.Triangles();
+                if (triangles > SOFTWARE_OCCLUSION_MAX_TRIANGLES)
+                    break;
+            }
+            occluders.resize(count);
+        }
+        // instances are grouped by model, so in instance order each model's occluders are consecutive
+        std::sort(occluders.begin(), occluders.end(), [](const Occluder& a, const Occluder& b) { return a.instance < b.instance; });
+    }
+
+    // the depth pre-pass: draws the objects covering the most of the screen into the HiZBuffer, in full detail, and
+    // builds its pyramid. Returns the buffer if objects can be tested against it this frame: on the GPU route if
+    // anything was drawn, on the CPU route if a pyramid read back from this or an earlier frame has arrived.
+    const HiZBuffer* drawOccluders(const OcclusionView& view, const Frustum* frustum) const
+    {
+        PROFILE_ZONE("Scene::occluders");
+        if (!hiZ)
+        {
+            hiZ.reset(new HiZBuffer());
+            hiZ->Create();
+            glGenBuffers(1, &occluderVBO);
+        }
+
+        selectOccluders(view, frustum, false);
+        if (occluders.empty())
+        {
+            hiZ->Discard();
+            return nullptr;
+        }
+        occluderTransforms.resize(occluders.size());
+        for (size_t i = 0; i < occluders.size(); i++)
+            occluderTransforms[i] = transforms[occluders[i].instance];
+        glBindBuffer(GL_ARRAY_BUFFER, occluderVBO);
+        glBufferData(GL_ARRAY_BUFFER, MAX_OCCLUDERS * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, occluderTransforms.size() * sizeof(glm::mat4), occluderTransforms.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        hiZ->BeginOccluders();
+        GLStateCache& state = GLStateCache::Instance();
+        state.Invalidate();
+        state.UseProgram(hiZ->DepthShader().ID);
+        for (size_t first = 0, end; first < occluders.size(); first = end)
+        {
+            const Model& model = *objectModel(occluders[first].instance);
+            for (end = first + 1; end < occluders.size() && objectModel(occluders[end].instance) == &model; end++)
+                ;
+            for (size_t batch = 0; batch < model.BatchCount(0); batch++)
+                model.DrawBatchDepthInstanced(occluderVBO, first, end - first, 0, batch);
+        }
+        state.Reset();
+        hiZ->Build(view.viewProjection, !gpuCulling);
+        if (gpuCulling)
+            return hiZ.get();
+        hiZ->Collect();
+        return hiZ->Ready() ? hiZ.get() : nullptr;
+    }
+
+    // rasterizes the proxies of the objects covering the most of the screen into the SoftwareOcclusion buffer.
+    // Returns the buffer, unless there was nothing to rasterize.
+    const SoftwareOcclusion* rasterizeOccluders(const OcclusionView& view, const Frustum* frustum) const
+    {
+        PROFILE_ZONE("Scene::rasterizeOccluders");
+        selectOccluders(view, frustum, true);
+        if (occluders.empty())
+            return nullptr;
+        occluderDraws.clear();
+        for (const Occluder& occluder : occluders)
+            occluderDraws.push_back({ &objectModel(occluder.instance)->occluder, transforms[occluder.instance] });
+        softwareOcclusion->Render(occluderDraws, view.viewProjection);
+        return softwareOcclusion.get();
+    }
+
+    // fills the render queue with the draws of the instances packed for this frame. A draw's depth is that of its
+    // nearest object, taken from the object's origin.
+    void queueDraws(const Shader& shader, const glm::vec3* eye) const
+    {
+        PROFILE_ZONE("Scene::queue");
+        queue.Clear();
+        queued.clear();
+        const vector<glm::mat4>& packed = allVisible ? transforms : visibleTransforms;
+        for (const InstanceGroup& group : groups)
+            for (unsigned int level = 0; level < MAX_LOD_LEVELS; level++)
+            {
+                size_t first = group.lodFirst[level], count = group.lodCount[level];
+                if (count == 0)
+                    continue;
+                float nearest = 0.0f;
+                if (eye)
+                {
+                    nearest = FLT_MAX;
+                    for (size_t i = first; i < first + count; i++)
+                        nearest = std::min(nearest, glm::distance(*eye, glm::vec3(packed[i][3])));
+                }
+                const Model& model = *group.model;
+                for (size_t batch = 0; batch < model.BatchCount(level); batch++)
+                {
+                    uint64_t key = MakeRenderKey(RENDER_PASS_OPAQUE, shader.ID, model.BatchMaterial(level, batch),
+                                                 model.BatchVertexArray(level, batch), nearest);
+                    queue.Push(key, static_cast<uint32_t>(queued.size()));
+                    queued.push_back({ &model, level, batch, first, count });
+                }
+            }
+    }
+
+    // uploads every object's transform
+    void showAll() const
+    {
+        for (InstanceGroup& group : groups)
+        {
+            std::fill(std::begin(group.lodCount), std::end(group.lodCount), 0);
+            group.lodFirst[0] = group.firstInstance;
+            group.lodCount[0] = group.instanceCount;
+        }
+        upload(transforms);
+        allVisible = true;
+    }
+
+    // finds the objects inside the frustum (all of them without one) through the hierarchy, drops those the
+    // occluders hide (in the HiZBuffer or the rasterized ones), picks their levels of detail (the full one without a
+    // selector), and uploads just their transforms, packed per model and level. The occlusion tests and level
+    // picks run in parallel on the JobSystem; counting and packing is sequential.
+    void pack(const Frustum* frustum, const LodSelector* lod, const HiZBuffer* occluders, const SoftwareOcclusion* rasterized) const
+    {
+        PROFILE_ZONE("Scene::cull");
+        if (frustum)
+        {
+            std::fill(visible.begin(), visible.end(), 0);
+            hierarchy.Cull(*frustum, [this](uint32_t instance) { visible[instance] = 1; });
+        }
+        else
+            std::fill(visible.begin(), visible.end(), 1);
+
+        JobSystem::Instance().ParallelFor(visible.size(), SCENE_JOB_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                if (!visible[i])
+                    continue;
+                if ((occluders && occluders->Occluded(boxes[i])) || (rasterized && rasterized->Occluded(boxes[i])))
+                {
+                    visible[i] = OCCLUDED;
+                    continue;
+                }
+                const Model& model = *objectModel(i);
+                unsigned int level = lod && model.LodCount() > 1 ? lod->Select(model, spheres[i], errorScales[i]) : 0;
+                visible[i] = static_cast<uint8_t>(1 + level);
+            }
+        });
+
+        size_t visibleTotal = 0, simplified = 0, occluded = 0;
+        for (InstanceGroup& group : groups)
+        {
+            // count the objects per level, then sort them into place
+            size_t end = group.firstInstance + group.instanceCount;
+            std::fill(std::begin(group.lodCount), std::end(group.lodCount), 0);
+            for (size_t i = group.firstInstance; i < end; i++)
+            {
+                if (visible[i] == OCCLUDED)
+                {
+                    visible[i] = 0;
+                    occluded++;
+                }
+                else if (visible[i])
+                    group.lodCount[visible[i] - 1]++;
+            }
+            for (unsigned int level = 0; level < MAX_LOD_LEVELS; level++)
+            {
+                group.lodFirst[level] = visibleTotal;
+                visibleTotal += group.lodCount[level];
+                if (level > 0)
+                    simplified += group.lodCount[level];
+            }
+            size_t filled[MAX_LOD_LEVELS] = {};
+            for (size_t i = group.firstInstance; i < end; i++)
+                if (visible[i])
+                {
+                    unsigned int level = visible[i] - 1;
+                    visibleTransforms[group.lodFirst[level] + filled[level]++] = transforms[i];
+                }
+        }
+        upload(visibleTransforms, visibleTotal);
+        renderStats.submittedObjects += visibleTotal;
+        renderStats.culledObjects += transforms.size() - visibleTotal - occluded;
+        renderStats.occludedObjects += occluded;
+        renderStats.simplifiedObjects += simplified;
+        allVisible = false;
+    }
+
+    // replaces the contents of the instance buffer; the old storage is orphaned, so this doesn't wait for the
+    // GPU to finish drawing with it
+    void upload(const vector<glm::mat4>& source, size_t count = SIZE_MAX) const
+    {
+        count = std::min(count, source.size());
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, source.size() * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+        if (count)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), source.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
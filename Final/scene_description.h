@@ -0,0 +1,243 @@
+#ifndef SCENE_DESCRIPTION_H
+#define SCENE_DESCRIPTION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "model.h"
+#include "model_streamer.h"
+#include "scene.h"
+#include "texture_loader.h"
+#include "texture_registry.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// a model file placed in the world by a scene description
+struct SceneModelPlacement {
+    string path;
+    glm::mat4 transform = glm::mat4(1.0f);
+};
+
+// what to load and where to look from, so runs can be repeated exactly. Scene description files are plain text,
+// one statement per line, '#' starts a comment:
+//   model <path> [x y z [scale]]                  places a model; the same path may be placed any number of times
+//   grid <path> <columns> <rows> <spacing> [scale] places copies of a model on a grid centered on the origin,
+//                                                  each turned differently (a synthetic forest, for benchmarks)
+//   orbit <radius> <height> [targetX targetY targetZ]  the camera path: one circle around the target per run
+struct SceneDescription {
+    vector<SceneModelPlacement> models;
+    float orbitRadius = 3.0f;
+    float orbitHeight = 0.0f;
+    glm::vec3 orbitTarget = glm::vec3(0.0f);
+
+    // the scene the application shows when it isn't given a description
+    static SceneDescription Default()
+    {
+        SceneDescription description;
+        description.models.push_back({ "resources/objects/tree3/tree4.obj", glm::mat4(1.0f) });
+        return description;
+    }
+
+    // the camera's view matrix at a point along the path; t runs from 0 to 1 over the whole run
+    glm::mat4 OrbitView(float t) const
+    {
+        float angle = t * glm::two_pi<float>();
+        glm::vec3 eye = orbitTarget + glm::vec3(orbitRadius * sin(angle), orbitHeight, orbitRadius * cos(angle));
+        return glm::lookAt(eye, orbitTarget, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+};
+
+// reads a scene description file; returns false and reports the offending line if it can't be parsed
+inline bool LoadSceneDescription(const string& path, SceneDescription& description)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cout << "ERROR::SCENE::FILE_NOT_SUCCESSFULLY_READ: " << path << endl;
+        return false;
+    }
+
+    description = SceneDescription();
+    string line;
+    for (unsigned int lineNumber = 1; getline(file, line); lineNumber++)
+    {
+        size_t comment = line.find('#');
+        if (comment != string::npos)
+            line.erase(comment);
+        istringstream statement(line);
+        string keyword;
+        if (!(statement >> keyword))
+            continue;
+
+        // everything after the keyword (and the model path) must be numbers
+        string modelPath;
+        if (keyword == "model" || keyword == "grid")
+            statement >> modelPath;
+        vector<float> numbers;
+        float number;
+        while (statement >> number)
+            numbers.push_back(number);
+        bool valid = statement.eof();
+
+        if (keyword == "model")
+        {
+            valid = valid && !modelPath.empty() && (numbers.empty() || numbers.size() == 3 || numbers.size() == 4);
+            if (valid)
+            {
+                SceneModelPlacement placement;
+                placement.path = modelPath;
+                if (numbers.size() >= 3)
+                    placement.transform = glm::translate(placement.transform, glm::vec3(numbers[0], numbers[1], numbers[2]));
+                if (numbers.size() == 4)
+                    placement.transform = glm::scale(placement.transform, glm::vec3(numbers[3]));
+                description.models.push_back(placement);
+            }
+        }
+        else if (keyword == "grid")
+        {
+            valid = valid && !modelPath.empty() && (numbers.size() == 3 || numbers.size() == 4) && numbers[0] >= 1.0f && numbers[1] >= 1.0f;
+            if (valid)
+            {
+                unsigned int columns = static_cast<unsigned int>(numbers[0]), rows = static_cast<unsigned int>(numbers[1]);
+                float spacing = numbers[2];
+                float scale = numbers.size() == 4 ? numbers[3] : 1.0f;
+                for (unsigned int row = 0; row < rows; row++)
+                    for (unsigned int column = 0; column < columns; column++)
+                    {
+                        SceneModelPlacement placement;
+                        placement.path = modelPath;
+                        glm::vec3 position((column - (columns - 1) * 0.5f) * spacing, 0.0f, (row - (rows - 1) * 0.5f) * spacing);
+                        // golden angle steps, so neighbours never face the same way
+                        float angle = static_cast<float>(row * columns + column) * 2.39996323f;
+                        placement.transform = glm::translate(placement.transform, position);
+                        placement.transform = glm::rotate(placement.transform, angle, glm::vec3(0.0f, 1.0f, 0.0f));
+                        placement.transform = glm::scale(placement.transform, glm::vec3(scale));
+                        description.models.push_back(placement);
+                    }
+            }
+        }
+        else if (keyword == "orbit")
+        {
+            valid = valid && (numbers.size() == 2 || numbers.size() == 5);
+            if (valid)
+            {
+                description.orbitRadius = numbers[0];
+                description.orbitHeight = numbers[1];
+                if (numbers.size() == 5)
+                    description.orbitTarget = glm::vec3(numbers[2], numbers[3], numbers[4]);
+            }
+        }
+        else
+            valid = false;
+        if (!valid)
+        {
+            cout << "ERROR::SCENE::INVALID_STATEMENT " << path << ":" << lineNumber << ": " << line << endl;
+            return false;
+        }
+    }
+    if (description.models.empty())
+    {
+        cout << "ERROR::SCENE::NO_MODELS " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+// loads every model of the description once (however often it is placed), decoding all their textures as one
+// batch, and places them in the scene. The models must outlive the scene.
+inline void BuildScene(const SceneDescription& description, vector<unique_ptr<Model>>& models, Scene& scene)
+{
+    TextureLoader textureLoader;
+    vector<pair<string, const Model*>> loaded;
+    for (const SceneModelPlacement& placement : description.models)
+    {
+        const Model* model = nullptr;
+        for (const auto& entry : loaded)
+            if (entry.first == placement.path)
+                model = entry.second;
+        if (!model)
+        {
+            models.push_back(unique_ptr<Model>(new Model(placement.path, false, &textureLoader)));
+            model = models.back().get();
+            loaded.push_back(make_pair(placement.path, model));
+        }
+        scene.Add(*model, placement.transform);
+    }
+    textureLoader.Flush();
+    cout << "TEXTURE::REGISTRY " << TextureRegistry::Instance().UniqueCount() << " unique textures for "
+         << TextureRegistry::Instance().ReferenceCount() << " references" << endl;
+}
+// a scene description loaded in the background (see ModelStreamer): Start requests every model once, and each
+// Update places the objects of the models whose meshes have arrived since, so the render loop can draw from the
+// first frame and the scene fills in as loading goes on. The requests hold the models, so this must outlive the scene.
+class StreamedScene
+{
+public:
+    void Start(const SceneDescription& description, ModelStreamer& streamer)
+    {
+        for (const SceneModelPlacement& placement : description.models)
+        {
+            StreamedModel* model = nullptr;
+            for (StreamedModel& entry : models)
+                if (entry.request->path == placement.path)
+                    model = &entry;
+            if (!model)
+            {
+                models.push_back({ streamer.Load(placement.path), {}, false });
+                model = &models.back();
+            }
+            model->transforms.push_back(placement.transform);
+        }
+        waiting = models.size();
+    }
+
+    // places the objects of newly arrived models; returns whether anything was added. Must run on the GL thread.
+    bool Update(Scene& scene)
+    {
+        if (waiting == 0)
+            return false;
+        bool added = false;
+        for (StreamedModel& entry : models)
+        {
+            if (entry.placed || (!entry.request->Get() && !entry.request->Failed()))
+                continue;
+            entry.placed = true;
+            waiting--;
+            if (const Model* model = entry.request->Get())
+            {
+                for (const glm::mat4& transform : entry.transforms)
+                    scene.Add(*model, transform);
+                objects += entry.transforms.size();
+                added = true;
+            }
+        }
+        if (waiting == 0)
+            cout << "SCENE::STREAMED " << objects << " objects from " << models.size() << " models" << endl;
+        return added;
+    }
+
+    // whether every model has been placed (or failed to load)
+    bool Placed() const
+    {
+        return waiting == 0;
+    }
+
+private:
+    struct StreamedModel {
+        shared_ptr<ModelStreamer::Request> request;
+        vector<glm::mat4> transforms;
+        bool placed;
+    };
+    vector<StreamedModel> models;
+    size_t waiting = 0; // models not placed yet
+    size_t objects = 0; // placed so far
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef COMPUTE_SHADER_H
+#define COMPUTE_SHADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_extensions.h"
+#include "shader_m.h"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// a compute shader program, the counterpart of Shader for GL 4.3 contexts (see glExtensions.computeAndIndirect).
+// Its uniforms are reflected once after linking, like Shader's; compute passes resolve the handles of the ones they
+// set per dispatch up front.
+class ComputeShader
+{
+public:
+    unsigned int ID = 0;
+
+    // constructor generates the shader on the fly
+    // ------------------------------------------------------------------------
+    explicit ComputeShader(const char* computePath)
+    {
+        // 1. retrieve the compute source code from filePath
+        std::string computeCode;
+        std::ifstream cShaderFile;
+        // ensure ifstream objects can throw exceptions:
+        cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            cShaderFile.open(computePath);
+            std::stringstream cShaderStream;
+            cShaderStream << cShaderFile.rdbuf();
+            cShaderFile.close();
+            computeCode = cShaderStream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+            return;
+        }
+        const char* cShaderCode = computeCode.c_str();
+        // 2. compile shader
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        bool compiled = checkCompileErrors(compute, "COMPUTE");
+        // shader Program
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        linked = compiled && checkCompileErrors(ID, "PROGRAM");
+        // delete the shader as it's linked into our program now and no longer necessary
+        glDeleteShader(compute);
+        // look up every active uniform once, so setting uniforms never has to ask the driver for a location
+        if (linked)
+            uniforms.Reflect(ID);
+    }
+
+    ~ComputeShader()
+    {
+        if (ID)
+            glDeleteProgram(ID);
+    }
+
+    ComputeShader(const ComputeShader&) = delete;
+    ComputeShader& operator=(const ComputeShader&) = delete;
+
+    // whether the program compiled and linked
+    bool Linked() const
+    {
+        return linked;
+    }
+
+    // activate the shader
+    // ------------------------------------------------------------------------
+    void use() const
+    {
+        glUseProgram(ID);
+    }
+
+    // runs enough work groups of groupSize invocations to cover count items
+    void dispatch(unsigned int count, unsigned int groupSize) const
+    {
+        if (count > 0)
+            glExtensions.dispatchCompute((count + groupSize - 1) / groupSize, 1, 1);
+    }
+
+    // returns the pre-resolved handle of a uniform
+    // ------------------------------------------------------------------------
+    UniformHandle uniform(const std::string& name) const
+    {
+        return uniforms.Handle(name);
+    }
+
+    // utility uniform functions taking pre-resolved handles
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle uniform, bool value) const
+    {
+        glUniform1i(uniform.location, (int)value);
+    }
+    void setInt(UniformHandle uniform, int value) const
+    {
+        glUniform1i(uniform.location, value);
+    }
+    void setUint(UniformHandle uniform, unsigned int value) const
+    {
+        glUniform1ui(uniform.location, value);
+    }
+    void setFloat(UniformHandle uniform, float value) const
+    {
+        glUniform1f(uniform.location, value);
+    }
+    void setVec2(UniformHandle uniform, const glm::vec2& value) const
+    {
+        glUniform2fv(uniform.location, 1, &value[0]);
+    }
+    void setIvec2(UniformHandle uniform, const glm::ivec2& value) const
+    {
+        glUniform2iv(uniform.location, 1, &value[0]);
+    }
+    void setVec3(UniformHandle uniform, const glm::vec3& value) const
+    {
+        glUniform3fv(uniform.location, 1, &value[0]);
+    }
+    void setVec4Array(UniformHandle uniform, const glm::vec4* values, GLsizei count) const
+    {
+        glUniform4fv(uniform.location, count, &values[0][0]);
+    }
+    void setMat4(UniformHandle uniform, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+
+private:
+    bool linked = false;
+    UniformTable uniforms;
+
+    // utility function for checking shader compilation/linking errors; returns whether it succeeded
+    // ------------------------------------------------------------------------
+    bool checkCompileErrors(GLuint shader, std::string type)
+    {
+        GLint success;
+        GLchar infoLog[1024];
+        if (type != "PROGRAM")
+        {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+        else
+        {
+            glGetProgramiv(shader, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+        return success != 0;
+    }
+};
+#endif
@@ -4,10 +4,79 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "render_stats.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// a uniform location resolved once up front. An inactive uniform has location -1, which glUniform* silently ignores.
+struct UniformHandle
+{
+    GLint location = -1;
+
+    bool valid() const { return location != -1; }
+};
+
+// the locations of a linked program's active uniforms by name, looked up once so setting uniforms never has to ask
+// the driver for one. Shader and ComputeShader fill one right after linking.
+class UniformTable
+{
+public:
+    // queries all active uniforms of the linked program and caches their locations
+    void Reflect(GLuint program)
+    {
+        locations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            GLint uniformLocation = glGetUniformLocation(program, name.c_str());
+            if (uniformLocation == -1)
+                continue; // members of uniform blocks have no location of their own
+            locations[name] = uniformLocation;
+
+            // arrays are reported once as "name[0]", so register the bare name and every other element as well
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                locations[base] = uniformLocation;
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    locations[elementName] = glGetUniformLocation(program, elementName.c_str());
+                }
+            }
+        }
+    }
+
+    // location of a uniform by name, or -1 if the program has no such active uniform
+    GLint Location(const std::string& name) const
+    {
+        auto it = locations.find(name);
+        return it != locations.end() ? it->second : -1;
+    }
+
+    UniformHandle Handle(const std::string& name) const
+    {
+        UniformHandle handle;
+        handle.location = Location(name);
+        return handle;
+    }
+
+private:
+    std::unordered_map<std::string, GLint> locations;
+};
 
 class Shader
 {
@@ -68,6 +137,8 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        // look up every active uniform once, so setting uniforms never has to ask the driver for a location
+        uniforms.Reflect(ID);
 
     }
     // activate the shader
@@ -75,67 +146,133 @@ public:
     void use() const
     {
         glUseProgram(ID);
+        renderStats.shaderBinds++;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(location(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(location(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(location(name), 1, &value[0]);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(location(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(location(name), 1, &value[0]);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(location(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(location(name), 1, &value[0]);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(location(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
+    // returns the pre-resolved handle of a uniform, for uniforms that are set every frame or every draw
+    // ------------------------------------------------------------------------
+    UniformHandle uniform(const std::string& name) const
+    {
+        return uniforms.Handle(name);
+    }
+    // utility uniform functions taking pre-resolved handles
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle uniform, bool value) const
+    {
+        glUniform1i(uniform.location, (int)value);
+    }
+    void setInt(UniformHandle uniform, int value) const
+    {
+        glUniform1i(uniform.location, value);
+    }
+    void setFloat(UniformHandle uniform, float value) const
+    {
+        glUniform1f(uniform.location, value);
+    }
+    void setVec2(UniformHandle uniform, const glm::vec2& value) const
+    {
+        glUniform2fv(uniform.location, 1, &value[0]);
+    }
+    void setVec2(UniformHandle uniform, float x, float y) const
+    {
+        glUniform2f(uniform.location, x, y);
+    }
+    void setVec3(UniformHandle uniform, const glm::vec3& value) const
+    {
+        glUniform3fv(uniform.location, 1, &value[0]);
+    }
+    void setVec3(UniformHandle uniform, float x, float y, float z) const
+    {
+        glUniform3f(uniform.location, x, y, z);
+    }
+    void setVec4(UniformHandle uniform, const glm::vec4& value) const
+    {
+        glUniform4fv(uniform.location, 1, &value[0]);
+    }
+    void setVec4(UniformHandle uniform, float x, float y, float z, float w) const
+    {
+        glUniform4f(uniform.location, x, y, z, w);
+    }
+    void setMat2(UniformHandle uniform, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformHandle uniform, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformHandle uniform, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // location of every active uniform by name, filled once after linking
+    UniformTable uniforms;
+
+    // location of a uniform by name, or -1 if the program has no such active uniform
+    GLint location(const std::string& name) const
+    {
+        return uniforms.Location(name);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,429 @@
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "hiz.h"
+#include "job_system.h"
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#if defined(__AVX2__)
+#define OCCLUSION_SIMD_WIDTH 8
+#define OCCLUSION_SIMD_NAME "AVX2"
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SIMD_WIDTH 4
+#define OCCLUSION_SIMD_NAME "SSE2"
+#include <emmintrin.h>
+#else
+#define OCCLUSION_SIMD_WIDTH 1
+#define OCCLUSION_SIMD_NAME "scalar"
+#endif
+
+// the software depth buffer: a power of two across, like a Hi-Z level, so the same pyramid test applies to it (see
+// RectOccluded), and cut into tiles that are rasterized independently of each other
+const unsigned int SOFTWARE_OCCLUSION_WIDTH = 256;
+const unsigned int SOFTWARE_OCCLUSION_HEIGHT = 128;
+const unsigned int OCCLUSION_TILE_WIDTH = 64;
+const unsigned int OCCLUSION_TILE_HEIGHT = 16;
+// a model's occluder proxy is its finest level of detail with at most this many triangles
+const size_t OCCLUDER_PROXY_MAX_TRIANGLES = 2048;
+// the occluders of one frame rasterize at most this many proxy triangles between them
+const size_t SOFTWARE_OCCLUSION_MAX_TRIANGLES = 32768;
+
+// the low-poly stand-in of a model that the software rasterizer draws when the model is an occluder: model space
+// positions and the triangles over them, nothing else a vertex has
+struct OccluderProxy {
+    vector<glm::vec3> positions;
+    vector<uint32_t> indices;
+
+    size_t Triangles() const
+    {
+        return indices.size() / 3;
+    }
+
+    bool Empty() const
+    {
+        return indices.empty();
+    }
+};
+
+// takes the finest level of detail whose triangles over all meshes fit in OCCLUDER_PROXY_MAX_TRIANGLES, keeping
+// just the positions it uses. Coarser levels stray further from the model, and a proxy sticking out past the model
+// hides what it shouldn't, so the finest level that fits is the one to take. Meshes with fewer levels than others
+// give their coarsest one. The proxy is empty if not even the coarsest level fits.
+inline OccluderProxy BuildOccluderProxy(const vector<CachedMesh>& meshes)
+{
+    auto levelIndices = [](const CachedMesh& mesh, size_t level) -> const vector<unsigned int>& {
+        return level == 0 || mesh.lods.empty() ? mesh.indices : mesh.lods[std::min(level, mesh.lods.size()) - 1].indices;
+    };
+    size_t levels = 1;
+    for (const CachedMesh& mesh : meshes)
+        levels = std::max(levels, 1 + mesh.lods.size());
+
+    OccluderProxy proxy;
+    for (size_t level = 0; level < levels; level++)
+    {
+        size_t triangles = 0;
+        for (const CachedMesh& mesh : meshes)
+            triangles += levelIndices(mesh, level).size() / 3;
+        if (triangles > OCCLUDER_PROXY_MAX_TRIANGLES)
+            continue;
+        proxy.indices.reserve(triangles * 3);
+        vector<uint32_t> remap;
+        for (const CachedMesh& mesh : meshes)
+        {
+            remap.assign(mesh.vertices.size(), UINT32_MAX);
+            for (unsigned int index : levelIndices(mesh, level))
+            {
+                if (remap[index] == UINT32_MAX)
+                {
+                    remap[index] = static_cast<uint32_t>(proxy.positions.size());
+                    proxy.positions.push_back(mesh.vertices[index].Position);
+                }
+                proxy.indices.push_back(remap[index]);
+            }
+        }
+        break;
+    }
+    return proxy;
+}
+
+// OCCLUSION_SIMD_WIDTH pixels of a row at a time. The wrappers keep the rasterizer the same for AVX2, SSE2 and
+// plain floats.
+#if OCCLUSION_SIMD_WIDTH == 8
+typedef __m256 OcclusionLanes;
+inline OcclusionLanes LanesSet(float value) { return _mm256_set1_ps(value); }
+inline OcclusionLanes LanesRamp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+inline OcclusionLanes LanesAdd(OcclusionLanes a, OcclusionLanes b) { return _mm256_add_ps(a, b); }
+inline OcclusionLanes LanesMul(OcclusionLanes a, OcclusionLanes b) { return _mm256_mul_ps(a, b); }
+inline OcclusionLanes LanesMin(OcclusionLanes a, OcclusionLanes b) { return _mm256_min_ps(a, b); }
+inline OcclusionLanes LanesLoad(const float* source) { return _mm256_loadu_ps(source); }
+inline void LanesStore(float* target, OcclusionLanes value) { _mm256_storeu_ps(target, value); }
+// one bit per lane, set where the lane is negative
+inline int LanesNegative(OcclusionLanes value) { return _mm256_movemask_ps(value); }
+// a where select is negative, b elsewhere
+inline OcclusionLanes LanesSelect(OcclusionLanes select, OcclusionLanes a, OcclusionLanes b) { return _mm256_blendv_ps(b, a, select); }
+#elif OCCLUSION_SIMD_WIDTH == 4
+typedef __m128 OcclusionLanes;
+inline OcclusionLanes LanesSet(float value) { return _mm_set1_ps(value); }
+inline OcclusionLanes LanesRamp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+inline OcclusionLanes LanesAdd(OcclusionLanes a, OcclusionLanes b) { return _mm_add_ps(a, b); }
+inline OcclusionLanes LanesMul(OcclusionLanes a, OcclusionLanes b) { return _mm_mul_ps(a, b); }
+inline OcclusionLanes LanesMin(OcclusionLanes a, OcclusionLanes b) { return _mm_min_ps(a, b); }
+inline OcclusionLanes LanesLoad(const float* source) { return _mm_loadu_ps(source); }
+inline void LanesStore(float* target, OcclusionLanes value) { _mm_storeu_ps(target, value); }
+inline int LanesNegative(OcclusionLanes value) { return _mm_movemask_ps(value); }
+inline OcclusionLanes LanesSelect(OcclusionLanes select, OcclusionLanes a, OcclusionLanes b)
+{
+    // SSE2 has no blend: spread each lane's sign bit over the lane
+    __m128 mask = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(select), 31));
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#else
+typedef float OcclusionLanes;
+inline OcclusionLanes LanesSet(float value) { return value; }
+inline OcclusionLanes LanesRamp() { return 0.0f; }
+inline OcclusionLanes LanesAdd(OcclusionLanes a, OcclusionLanes b) { return a + b; }
+inline OcclusionLanes LanesMul(OcclusionLanes a, OcclusionLanes b) { return a * b; }
+inline OcclusionLanes LanesMin(OcclusionLanes a, OcclusionLanes b) { return std::min(a, b); }
+inline OcclusionLanes LanesLoad(const float* source) { return *source; }
+inline void LanesStore(float* target, OcclusionLanes value) { *target = value; }
+inline int LanesNegative(OcclusionLanes value) { return std::signbit(value) ? 1 : 0; }
+inline OcclusionLanes LanesSelect(OcclusionLanes select, OcclusionLanes a, OcclusionLanes b) { return std::signbit(select) ? a : b; }
+#endif
+const int OCCLUSION_LANES_ALL = (1 << OCCLUSION_SIMD_WIDTH) - 1;
+
+// a triangle set up for rasterizing, in pixels of the depth buffer: three edge functions A x + B y + C, positive
+// inside, and a depth plane, both evaluated at pixel (x, y) directly (the half pixel to its center is folded in)
+struct OcclusionTriangle {
+    float edgeA[3], edgeB[3], edgeC[3];
+    // depth = depthA x + depthB y + depthC, taken at the farthest point of the pixel rather than its center, and
+    // never farther than depthMax, the farthest corner: a pixel never ends up nearer than the triangle
+    float depthA, depthB, depthC;
+    float depthMax;
+    int minX, minY, maxX, maxY; // the pixels whose centers it may cover, inclusive
+};
+
+// sets up a triangle from screen vertices: x and y in pixels, z the depth and w negative if the vertex is nearer
+// than the near plane. Returns false if the triangle covers no pixel center or reaches nearer than the near plane;
+// leaving such a triangle out only ever hides less. Both sides of a triangle count, as the GL draws them.
+inline bool SetupOcclusionTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, int width, int height, OcclusionTriangle& triangle)
+{
+    if (a.w <= 0.0f || b.w <= 0.0f || c.w <= 0.0f)
+        return false;
+    glm::vec3 v[3] = { glm::vec3(a), glm::vec3(b), glm::vec3(c) };
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+    if (area < 0.0f)
+    {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+    if (!(area > 1e-6f))
+        return false;
+
+    float lowX = std::max(std::min({ v[0].x, v[1].x, v[2].x }) - 0.5f, 0.0f);
+    float highX = std::min(std::max({ v[0].x, v[1].x, v[2].x }) - 0.5f, width - 1.0f);
+    float lowY = std::max(std::min({ v[0].y, v[1].y, v[2].y }) - 0.5f, 0.0f);
+    float highY = std::min(std::max({ v[0].y, v[1].y, v[2].y }) - 0.5f, height - 1.0f);
+    if (!(lowX <= highX && lowY <= highY))
+        return false;
+    triangle.minX = static_cast<int>(ceil(lowX));
+    triangle.maxX = static_cast<int>(floor(highX));
+    triangle.minY = static_cast<int>(ceil(lowY));
+    triangle.maxY = static_cast<int>(floor(highY));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        return false;
+
+    // edge i runs from vertex i to the next one and is zero there; at the vertex opposite it, it is the area
+    triangle.depthA = triangle.depthB = triangle.depthC = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        const glm::vec3& from = v[i];
+        const glm::vec3& to = v[(i + 1) % 3];
+        float edgeA = from.y - to.y, edgeB = to.x - from.x, edgeC = from.x * to.y - from.y * to.x;
+        float opposite = v[(i + 2) % 3].z / area;
+        triangle.depthA += edgeA * opposite;
+        triangle.depthB += edgeB * opposite;
+        triangle.depthC += edgeC * opposite;
+        triangle.edgeA[i] = edgeA;
+        triangle.edgeB[i] = edgeB;
+        triangle.edgeC[i] = edgeC + 0.5f * (edgeA + edgeB);
+    }
+    triangle.depthC += 0.5f * (triangle.depthA + triangle.depthB) + 0.5f * (fabs(triangle.depthA) + fabs(triangle.depthB));
+    triangle.depthMax = std::max({ v[0].z, v[1].z, v[2].z });
+    return true;
+}
+
+// draws the triangle's depth into the pixels of [tileX0, tileX1) x [tileY0, tileY1) it covers, keeping the nearest
+// depth. tileX0 must be a multiple of OCCLUSION_SIMD_WIDTH and the tile as wide as a multiple of it.
+inline void RasterizeOcclusionTriangle(const OcclusionTriangle& triangle, float* depths, int width, int tileX0, int tileY0, int tileX1, int tileY1)
+{
+    int x0 = std::max(triangle.minX, tileX0), x1 = std::min(triangle.maxX, tileX1 - 1);
+    int y0 = std::max(triangle.minY, tileY0), y1 = std::min(triangle.maxY, tileY1 - 1);
+    if (x0 > x1 || y0 > y1)
+        return;
+    x0 -= (x0 - tileX0) % OCCLUSION_SIMD_WIDTH;
+
+    const OcclusionLanes ramp = LanesRamp();
+    const float step = static_cast<float>(OCCLUSION_SIMD_WIDTH);
+    OcclusionLanes edgeRamp[3], edgeStep[3];
+    for (int i = 0; i < 3; i++)
+    {
+        edgeRamp[i] = LanesMul(ramp, LanesSet(triangle.edgeA[i]));
+        edgeStep[i] = LanesSet(triangle.edgeA[i] * step);
+    }
+    const OcclusionLanes depthRamp = LanesMul(ramp, LanesSet(triangle.depthA));
+    const OcclusionLanes depthStep = LanesSet(triangle.depthA * step);
+    const OcclusionLanes depthMax = LanesSet(triangle.depthMax);
+    for (int y = y0; y <= y1; y++)
+    {
+        float* row = depths + y * width;
+        float fx = static_cast<float>(x0), fy = static_cast<float>(y);
+        OcclusionLanes edge0 = LanesAdd(LanesSet(triangle.edgeA[0] * fx + triangle.edgeB[0] * fy + triangle.edgeC[0]), edgeRamp[0]);
+        OcclusionLanes edge1 = LanesAdd(LanesSet(triangle.edgeA[1] * fx + triangle.edgeB[1] * fy + triangle.edgeC[1]), edgeRamp[1]);
+        OcclusionLanes edge2 = LanesAdd(LanesSet(triangle.edgeA[2] * fx + triangle.edgeB[2] * fy + triangle.edgeC[2]), edgeRamp[2]);
+        OcclusionLanes depth = LanesAdd(LanesSet(triangle.depthA * fx + triangle.depthB * fy + triangle.depthC), depthRamp);
+        bool entered = false;
+        for (int x = x0; x <= x1; x += OCCLUSION_SIMD_WIDTH)
+        {
+            // negative wherever any edge is
+            OcclusionLanes outside = LanesMin(edge0, LanesMin(edge1, edge2));
+            if (LanesNegative(outside) != OCCLUSION_LANES_ALL)
+            {
+                OcclusionLanes stored = LanesLoad(row + x);
+                LanesStore(row + x, LanesSelect(outside, stored, LanesMin(stored, LanesMin(depth, depthMax))));
+                entered = true;
+            }
+            else if (entered)
+                break; // a triangle covers one span of a row, and it is behind us
+            edge0 = LanesAdd(edge0, edgeStep[0]);
+            edge1 = LanesAdd(edge1, edgeStep[1]);
+            edge2 = LanesAdd(edge2, edgeStep[2]);
+            depth = LanesAdd(depth, depthStep);
+        }
+    }
+}
+
+// one occluder for SoftwareOcclusion::Render: a proxy, placed in the world
+struct OccluderDraw {
+    const OccluderProxy* proxy;
+    glm::mat4 transform;
+};
+
+// occlusion culling on the CPU alone: the occluders' proxies are rasterized into a small depth buffer, which is
+// reduced into a pyramid like the HiZBuffer's, and boxes are tested against it right away. There is no readback, so
+// nothing shows a frame late, but the buffer is coarse: an occluder covering a pixel's center hides what is behind
+// the whole pixel.
+// Rendering runs on the JobSystem in two steps. First each occluder is a job that transforms its vertices, sets up
+// its triangles and bins each one into the tiles its bounds touch, in bins of its own. Then each tile is a job that
+// rasterizes every triangle binned there, so no two jobs write the same pixel.
+class SoftwareOcclusion
+{
+public:
+    explicit SoftwareOcclusion(JobSystem& jobs = JobSystem::Instance()) : jobs(jobs)
+    {
+        for (unsigned int width = SOFTWARE_OCCLUSION_WIDTH, height = SOFTWARE_OCCLUSION_HEIGHT;; width = std::max(width / 2, 1u), height = std::max(height / 2, 1u))
+        {
+            HiZLevel level;
+            level.width = width;
+            level.height = height;
+            level.depths.assign(width * height, 1.0f);
+            levels.push_back(std::move(level));
+            if (width == 1 && height == 1)
+                break;
+        }
+    }
+
+    SoftwareOcclusion(const SoftwareOcclusion&) = delete;
+    SoftwareOcclusion& operator=(const SoftwareOcclusion&) = delete;
+
+    // rasterizes the occluders as seen through viewProjection, replacing what was there
+    void Render(const vector<OccluderDraw>& occluders, const glm::mat4& viewProjection)
+    {
+        // where each occluder's vertices and triangles go
+        vertexFirst.resize(occluders.size() + 1);
+        triangleFirst.resize(occluders.size() + 1);
+        vertexFirst[0] = triangleFirst[0] = 0;
+        for (size_t i = 0; i < occluders.size(); i++)
+        {
+            vertexFirst[i + 1] = vertexFirst[i] + occluders[i].proxy->positions.size();
+            triangleFirst[i + 1] = triangleFirst[i] + occluders[i].proxy->Triangles();
+        }
+        screenVertices.resize(vertexFirst.back());
+        triangles.resize(triangleFirst.back());
+        if (bins.size() < occluders.size() * tileCount)
+            bins.resize(occluders.size() * tileCount);
+        for (size_t i = 0; i < occluders.size() * tileCount; i++)
+            bins[i].clear();
+
+        atomic<size_t> accepted(0);
+        jobs.ParallelFor(occluders.size(), 1, [&](size_t begin, size_t end) {
+            size_t setUp = 0;
+            for (size_t i = begin; i < end; i++)
+                setUp += setup(occluders[i], viewProjection, vertexFirst[i], triangleFirst[i], &bins[i * tileCount]);
+            accepted += setUp;
+        });
+        // every triangle is in its bins before any tile is drawn
+        jobs.ParallelFor(tileCount, 1, [&](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++)
+                rasterizeTile(static_cast<unsigned int>(tile), occluders.size());
+        });
+
+        ReduceHiZLevels(levels);
+        renderedViewProjection = viewProjection;
+        rasterizedTriangles = accepted;
+        ready = true;
+    }
+
+    // whether the box is hidden behind the occluders of the last Render
+    bool Occluded(const AABB& box) const
+    {
+        ScreenRect rect;
+        return ready && ProjectBox(box, renderedViewProjection, rect) && RectOccluded(rect, levels);
+    }
+
+    // the triangles the last Render set up and rasterized, after those covering no pixel were dropped
+    size_t RasterizedTriangles() const
+    {
+        return rasterizedTriangles;
+    }
+
+    unsigned int Threads() const
+    {
+        return jobs.Threads();
+    }
+
+    // the depth buffer and the pyramid over it, levels[0] the finest
+    const vector<HiZLevel>& Levels() const
+    {
+        return levels;
+    }
+
+private:
+    static constexpr unsigned int tilesX = SOFTWARE_OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH;
+    static constexpr unsigned int tilesY = SOFTWARE_OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT;
+    static constexpr unsigned int tileCount = tilesX * tilesY;
+    JobSystem& jobs;
+    vector<HiZLevel> levels;
+    glm::mat4 renderedViewProjection = glm::mat4(1.0f);
+    size_t rasterizedTriangles = 0;
+    bool ready = false;
+    // per frame, sized once and reused
+    vector<size_t> vertexFirst, triangleFirst;
+    vector<glm::vec4> screenVertices;
+    vector<OcclusionTriangle> triangles;
+    vector<vector<uint32_t>> bins; // per occluder, then per tile: the occluder's triangles there
+
+    // transforms the occluder's vertices to the screen and sets up and bins its triangles; returns how many it binned
+    size_t setup(const OccluderDraw& occluder, const glm::mat4& viewProjection, size_t firstVertex, size_t firstTriangle, vector<uint32_t>* tileBins)
+    {
+        glm::mat4 toClip = viewProjection * occluder.transform;
+        const vector<glm::vec3>& positions = occluder.proxy->positions;
+        glm::vec4* screen = &screenVertices[firstVertex];
+        const float width = static_cast<float>(SOFTWARE_OCCLUSION_WIDTH), height = static_cast<float>(SOFTWARE_OCCLUSION_HEIGHT);
+#if OCCLUSION_SIMD_WIDTH > 1
+        const __m128 column0 = _mm_loadu_ps(&toClip[0][0]), column1 = _mm_loadu_ps(&toClip[1][0]);
+        const __m128 column2 = _mm_loadu_ps(&toClip[2][0]), column3 = _mm_loadu_ps(&toClip[3][0]);
+#endif
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            const glm::vec3& position = positions[i];
+#if OCCLUSION_SIMD_WIDTH > 1
+            __m128 clipLanes = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(position.x)), _mm_mul_ps(column1, _mm_set1_ps(position.y))),
+                                          _mm_add_ps(_mm_mul_ps(column2, _mm_set1_ps(position.z)), column3));
+            glm::vec4 clip;
+            _mm_storeu_ps(&clip.x, clipLanes);
+#else
+            glm::vec4 clip = toClip * glm::vec4(position, 1.0f);
+#endif
+            // nearer than the near plane, the vertex is no use: w marks it
+            if (clip.w <= 0.0f || clip.z < -clip.w)
+            {
+                screen[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+                continue;
+            }
+            float inverseW = 1.0f / clip.w;
+            screen[i] = glm::vec4((clip.x * inverseW * 0.5f + 0.5f) * width, (clip.y * inverseW * 0.5f + 0.5f) * height,
+                                  clip.z * inverseW * 0.5f + 0.5f, 1.0f);
+        }
+
+        const vector<uint32_t>& indices = occluder.proxy->indices;
+        size_t setUp = 0;
+        for (size_t t = 0; t < indices.size() / 3; t++)
+        {
+            uint32_t id = static_cast<uint32_t>(firstTriangle + t);
+            OcclusionTriangle& triangle = triangles[id];
+            if (!SetupOcclusionTriangle(screen[indices[3 * t]], screen[indices[3 * t + 1]], screen[indices[3 * t + 2]],
+                                        SOFTWARE_OCCLUSION_WIDTH, SOFTWARE_OCCLUSION_HEIGHT, triangle))
+                continue;
+            for (unsigned int tileY = triangle.minY / OCCLUSION_TILE_HEIGHT; tileY <= triangle.maxY / OCCLUSION_TILE_HEIGHT; tileY++)
+                for (unsigned int tileX = triangle.minX / OCCLUSION_TILE_WIDTH; tileX <= triangle.maxX / OCCLUSION_TILE_WIDTH; tileX++)
+                    tileBins[tileY * tilesX + tileX].push_back(id);
+            setUp++;
+        }
+        return setUp;
+    }
+
+    // clears the tile and draws every triangle the occluders binned into it
+    void rasterizeTile(unsigned int tile, size_t occluderCount)
+    {
+        int tileX0 = static_cast<int>(tile % tilesX * OCCLUSION_TILE_WIDTH), tileY0 = static_cast<int>(tile / tilesX * OCCLUSION_TILE_HEIGHT);
+        int tileX1 = tileX0 + OCCLUSION_TILE_WIDTH, tileY1 = tileY0 + OCCLUSION_TILE_HEIGHT;
+        float* depths = levels[0].depths.data();
+        for (int y = tileY0; y < tileY1; y++)
+            std::fill(depths + y * SOFTWARE_OCCLUSION_WIDTH + tileX0, depths + y * SOFTWARE_OCCLUSION_WIDTH + tileX1, 1.0f);
+        for (size_t occluder = 0; occluder < occluderCount; occluder++)
+            for (uint32_t id : bins[occluder * tileCount + tile])
+                RasterizeOcclusionTriangle(triangles[id], depths, SOFTWARE_OCCLUSION_WIDTH, tileX0, tileY0, tileX1, tileY1);
+    }
+};
+#endif
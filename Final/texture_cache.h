@@ -0,0 +1,147 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "texture_compressor.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+using namespace std;
+
+// a processed texture (see ProcessTexture) on disk, in the spirit of KTX/DDS: a header naming the encoding, then
+// every mip level as it is uploaded, so a warm load reads one file and decodes nothing.
+// bump TEXTURE_CACHE_VERSION whenever the processing or the file layout below changes.
+const uint32_t TEXTURE_CACHE_MAGIC = 0x48435854; // "TXCH"
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+// identifies the exact source image and processing settings a cache file was built from
+struct TextureCacheKey {
+    string   sourcePath;
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint32_t color; // whether the mips were filtered in linear light
+    uint32_t s3tc;  // whether S3TC was available to encode to
+};
+
+// the cache file lives next to its source image
+inline string TextureCachePath(const string& sourcePath)
+{
+    return sourcePath + ".texcache";
+}
+
+// fills in the key for a source file; returns false if the file can't be stat'ed.
+inline bool TextureCacheKeyFor(const string& sourcePath, bool color, bool s3tc, TextureCacheKey& key)
+{
+    std::error_code ec;
+    auto size = std::filesystem::file_size(sourcePath, ec);
+    if (ec)
+        return false;
+    auto time = std::filesystem::last_write_time(sourcePath, ec);
+    if (ec)
+        return false;
+    key.sourcePath = sourcePath;
+    key.sourceSize = static_cast<uint64_t>(size);
+    key.sourceTime = static_cast<int64_t>(time.time_since_epoch().count());
+    key.color = color ? 1 : 0;
+    key.s3tc = s3tc ? 1 : 0;
+    return true;
+}
+
+// the fixed part of the file, followed by the source path and then, per level, its width, height, byte count and data
+struct TextureCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint32_t color;
+    uint32_t s3tc;
+    uint32_t encoding;
+    uint32_t components;
+    uint32_t levelCount;
+    uint32_t sourcePathLength;
+};
+
+// writes a processed texture to disk. Like WriteMeshCache it writes to a temporary name first and renames it into
+// place, so an interrupted write never leaves a half-valid cache.
+inline bool WriteTextureCache(const TextureCacheKey& key, const TextureLevels& texture)
+{
+    string cachePath = TextureCachePath(key.sourcePath);
+    string tempPath = cachePath + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+
+        TextureCacheHeader header = { TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, key.sourceSize, key.sourceTime, key.color, key.s3tc,
+                                      static_cast<uint32_t>(texture.encoding), static_cast<uint32_t>(texture.components),
+                                      static_cast<uint32_t>(texture.levels.size()), static_cast<uint32_t>(key.sourcePath.size()) };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(key.sourcePath.data(), key.sourcePath.size());
+        for (const TextureLevel& level : texture.levels)
+        {
+            uint32_t size[3] = { static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height), static_cast<uint32_t>(level.data.size()) };
+            out.write(reinterpret_cast<const char*>(size), sizeof(size));
+            out.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+        }
+        if (!out)
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+// reads the cache for the given key. Returns false (leaving texture empty) if there is no cache, or it was built
+// from a different source or settings.
+inline bool ReadTextureCache(const TextureCacheKey& key, TextureLevels& texture)
+{
+    texture = TextureLevels();
+
+    ifstream in(TextureCachePath(key.sourcePath), ios::binary);
+    if (!in)
+        return false;
+    TextureCacheHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION || header.sourceSize != key.sourceSize
+        || header.sourceTime != key.sourceTime || header.color != key.color || header.s3tc != key.s3tc
+        || header.encoding > TEXTURE_BC4 || header.levelCount > 32 || header.sourcePathLength != key.sourcePath.size())
+        return false;
+    string sourcePath(header.sourcePathLength, '\0');
+    if (!in.read(&sourcePath[0], sourcePath.size()) || sourcePath != key.sourcePath)
+        return false;
+
+    texture.encoding = static_cast<TextureEncoding>(header.encoding);
+    texture.components = static_cast<int>(header.components);
+    texture.levels.resize(header.levelCount);
+    for (TextureLevel& level : texture.levels)
+    {
+        uint32_t size[3];
+        // a level is never bigger than the source image would be uncompressed in RGBA
+        if (!in.read(reinterpret_cast<char*>(size), sizeof(size)) || size[2] > static_cast<uint64_t>(size[0]) * size[1] * 4 + 16)
+        {
+            texture = TextureLevels();
+            return false;
+        }
+        level.width = static_cast<int>(size[0]);
+        level.height = static_cast<int>(size[1]);
+        level.data.resize(size[2]);
+        if (!in.read(reinterpret_cast<char*>(level.data.data()), size[2]))
+        {
+            texture = TextureLevels();
+            return false;
+        }
+    }
+    return !texture.levels.empty();
+}
+#endif
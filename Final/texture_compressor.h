@@ -0,0 +1,460 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// the S3TC formats are an extension to GL 3.3 (RGTC is core), so the loader may not define them
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// import-time texture processing: the whole mip chain is built on the CPU and, where the GPU can sample it, block
+// compressed, so a texture is uploaded as it will be sampled and needs no glGenerateMipmap. Color textures are
+// filtered in linear light, so their mips don't darken.
+
+// how a texture's texels are stored on the GPU
+enum TextureEncoding {
+    TEXTURE_RAW, // 8 bits per channel, uncompressed
+    TEXTURE_BC1, // RGB in 4 bits per texel (DXT1)
+    TEXTURE_BC3, // RGBA in 8 bits per texel: BC1 color plus a BC4 alpha block (DXT5)
+    TEXTURE_BC4  // one channel in 4 bits per texel (RGTC1)
+};
+
+// one level of a mip chain: tightly packed rows of texels, or compressed 4x4 blocks
+struct TextureLevel {
+    int width = 0;
+    int height = 0;
+    vector<unsigned char> data;
+};
+
+// a texture with its whole mip chain, ready for upload
+struct TextureLevels {
+    TextureEncoding encoding = TEXTURE_RAW;
+    int components = 0; // of the uncompressed texels: 1, 3 or 4
+    vector<TextureLevel> levels;
+
+    bool Compressed() const
+    {
+        return encoding != TEXTURE_RAW;
+    }
+
+    // the internal format to upload with
+    GLenum InternalFormat() const
+    {
+        switch (encoding)
+        {
+        case TEXTURE_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TEXTURE_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TEXTURE_BC4: return GL_COMPRESSED_RED_RGTC1;
+        default: return components == 1 ? GL_R8 : components == 3 ? GL_RGB8 : GL_RGBA8;
+        }
+    }
+
+    // the pixel format of uncompressed levels
+    GLenum PixelFormat() const
+    {
+        return components == 1 ? GL_RED : components == 3 ? GL_RGB : GL_RGBA;
+    }
+
+    size_t Bytes() const
+    {
+        size_t bytes = 0;
+        for (const TextureLevel& level : levels)
+            bytes += level.data.size();
+        return bytes;
+    }
+
+    const char* EncodingName() const
+    {
+        static const char* names[] = { "raw", "BC1", "BC3", "BC4" };
+        return names[encoding];
+    }
+};
+
+// the sRGB transfer function both ways: a table from 8-bit sRGB to linear, and a fine table from linear back
+inline float SrgbToLinear(unsigned char value)
+{
+    static const vector<float> table = [] {
+        vector<float> t(256);
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table[value];
+}
+
+inline unsigned char LinearToSrgb(float value)
+{
+    const int STEPS = 16384;
+    static const vector<unsigned char> table = [] {
+        vector<unsigned char> t(STEPS + 1);
+        for (int i = 0; i <= STEPS; i++)
+        {
+            float c = static_cast<float>(i) / STEPS;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            t[i] = static_cast<unsigned char>(std::min(255.0f, s * 255.0f + 0.5f));
+        }
+        return t;
+    }();
+    return table[static_cast<int>(std::min(std::max(value, 0.0f), 1.0f) * STEPS + 0.5f)];
+}
+
+// the mip chain of an image down to 1x1, each level a 2x2 box filter of the one before (at odd sizes the last row
+// or column is folded into the one before it). With color set, RGB is averaged in linear light; alpha, and every
+// channel of data textures like normal maps, is averaged as stored.
+inline vector<TextureLevel> BuildMipChain(const unsigned char* pixels, int width, int height, int components, bool color)
+{
+    vector<TextureLevel> levels(1);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].data.assign(pixels, pixels + static_cast<size_t>(width) * height * components);
+
+    // the filter runs on floats, in linear light where that applies, so no rounding builds up down the chain
+    auto isColor = [&](int channel) { return color && channel < 3 && components >= 3; };
+    vector<float> current(levels[0].data.size());
+    for (size_t i = 0; i < current.size(); i++)
+        current[i] = isColor(static_cast<int>(i % components)) ? SrgbToLinear(pixels[i]) : pixels[i] / 255.0f;
+
+    vector<float> next;
+    while (width > 1 || height > 1)
+    {
+        int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+        next.assign(static_cast<size_t>(nextWidth) * nextHeight * components, 0.0f);
+        for (int y = 0; y < height; y++)
+        {
+            const float* source = &current[static_cast<size_t>(y) * width * components];
+            float* target = &next[static_cast<size_t>(std::min(y / 2, nextHeight - 1)) * nextWidth * components];
+            for (int x = 0; x < width; x++)
+            {
+                float* texel = target + std::min(x / 2, nextWidth - 1) * components;
+                for (int c = 0; c < components; c++)
+                    texel[c] += source[x * components + c];
+            }
+        }
+        // every target texel got the sum of a 2x2, 2x3, 3x2 or 3x3 footprint
+        for (int y = 0; y < nextHeight; y++)
+        {
+            int rows = (height == 1 ? 1 : 2) + (height > 1 && height % 2 && y == nextHeight - 1 ? 1 : 0);
+            for (int x = 0; x < nextWidth; x++)
+            {
+                int columns = (width == 1 ? 1 : 2) + (width > 1 && width % 2 && x == nextWidth - 1 ? 1 : 0);
+                float* texel = &next[(static_cast<size_t>(y) * nextWidth + x) * components];
+                for (int c = 0; c < components; c++)
+                    texel[c] /= static_cast<float>(rows * columns);
+            }
+        }
+
+        TextureLevel level;
+        level.width = width = nextWidth;
+        level.height = height = nextHeight;
+        level.data.resize(next.size());
+        for (size_t i = 0; i < next.size(); i++)
+            level.data[i] = isColor(static_cast<int>(i % components)) ? LinearToSrgb(next[i])
+                                                                     : static_cast<unsigned char>(std::min(255.0f, next[i] * 255.0f + 0.5f));
+        levels.push_back(std::move(level));
+        current.swap(next);
+    }
+    return levels;
+}
+
+// a BC4 block (also the alpha half of BC3): two 8-bit endpoints and a 3-bit index per texel into the 8 values
+// between them
+inline void EncodeBC4Block(const unsigned char values[16], unsigned char* out)
+{
+    unsigned char low = 255, high = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        low = std::min(low, values[i]);
+        high = std::max(high, values[i]);
+    }
+    out[0] = high;
+    out[1] = low;
+    uint64_t indices = 0;
+    if (high > low)
+    {
+        // the endpoints first (indices 0 and 1), then 6 steps from high down to low
+        int palette[8] = { high, low };
+        for (int i = 1; i <= 6; i++)
+            palette[i + 1] = ((7 - i) * high + i * low + 3) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = 256;
+            for (int p = 0; p < 8; p++)
+            {
+                int distance = std::abs(palette[p] - values[i]);
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+// an RGB color (0 to 255 per channel) as RGB565, and back
+inline uint16_t BC1Pack565(const float color[3])
+{
+    int r = static_cast<int>(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+inline void BC1Unpack565(uint16_t packed, float color[3])
+{
+    int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+    color[0] = static_cast<float>(r << 3 | r >> 2);
+    color[1] = static_cast<float>(g << 2 | g >> 4);
+    color[2] = static_cast<float>(b << 3 | b >> 2);
+}
+
+// the nearest of the four block colors for every texel, in 4-color mode; returns the squared error
+inline float BC1AssignIndices(const float texels[16][3], uint16_t color0, uint16_t color1, uint8_t indices[16])
+{
+    float palette[4][3];
+    BC1Unpack565(color0, palette[0]);
+    BC1Unpack565(color1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    float error = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float bestDistance = FLT_MAX;
+        for (uint8_t p = 0; p < 4; p++)
+        {
+            float dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+            float distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                indices[i] = p;
+            }
+        }
+        error += bestDistance;
+    }
+    return error;
+}
+
+// the endpoints that fit the texels best for the given indices (least squares); false if they're ill-defined
+inline bool BC1FitEndpoints(const float texels[16][3], const uint8_t indices[16], float endpoint0[3], float endpoint1[3])
+{
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f }; // of endpoint 0, per index
+    float aa = 0, ab = 0, bb = 0, ax[3] = {}, bx[3] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float a = weights[indices[i]], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++)
+        {
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < 3; c++)
+    {
+        endpoint0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+        endpoint1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+    }
+    return true;
+}
+
+// a BC1 block of RGBA texels (alpha is ignored): two RGB565 endpoints and a 2-bit index per texel into the 4 colors
+// between them. The endpoints start at the extremes of the block along its principal axis and are then refined by
+// least squares.
+inline void EncodeBC1Block(const unsigned char texels[16][4], unsigned char* out)
+{
+    float colors[16][3], mean[3] = {};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            colors[i][c] = texels[i][c];
+            mean[c] += colors[i][c] / 16.0f;
+        }
+
+    // the principal axis, by power iteration on the covariance
+    float covariance[6] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float r = colors[i][0] - mean[0], g = colors[i][1] - mean[1], b = colors[i][2] - mean[2];
+        covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+        covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+    }
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+        if (length < 1e-6f)
+            break;
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+    float low = FLT_MAX, high = -FLT_MAX;
+    int lowTexel = 0, highTexel = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = colors[i][0] * axis[0] + colors[i][1] * axis[1] + colors[i][2] * axis[2];
+        if (t < low) { low = t; lowTexel = i; }
+        if (t > high) { high = t; highTexel = i; }
+    }
+
+    uint16_t color0 = BC1Pack565(colors[highTexel]), color1 = BC1Pack565(colors[lowTexel]);
+    uint8_t indices[16] = {};
+    float error = BC1AssignIndices(colors, color0, color1, indices);
+    for (int iteration = 0; iteration < 2 && color0 != color1; iteration++)
+    {
+        float endpoint0[3], endpoint1[3];
+        if (!BC1FitEndpoints(colors, indices, endpoint0, endpoint1))
+            break;
+        uint16_t refined0 = BC1Pack565(endpoint0), refined1 = BC1Pack565(endpoint1);
+        uint8_t refinedIndices[16];
+        float refinedError = BC1AssignIndices(colors, refined0, refined1, refinedIndices);
+        if (refinedError >= error)
+            break;
+        color0 = refined0;
+        color1 = refined1;
+        error = refinedError;
+        memcpy(indices, refinedIndices, sizeof(indices));
+    }
+
+    // 4-color mode needs color0 > color1; a block of one color uses color0 only
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+        for (uint8_t& index : indices)
+            index ^= 1; // 0 <-> 1 and 2 <-> 3
+    }
+    else if (color0 == color1)
+        memset(indices, 0, sizeof(indices));
+
+    uint32_t packedIndices = 0;
+    for (int i = 0; i < 16; i++)
+        packedIndices |= static_cast<uint32_t>(indices[i]) << (2 * i);
+    out[0] = static_cast<unsigned char>(color0);
+    out[1] = static_cast<unsigned char>(color0 >> 8);
+    out[2] = static_cast<unsigned char>(color1);
+    out[3] = static_cast<unsigned char>(color1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = static_cast<unsigned char>(packedIndices >> (8 * i));
+}
+
+// compresses a level into 4x4 blocks; texels past the edge of levels smaller than a block repeat the edge
+inline TextureLevel CompressLevel(const TextureLevel& level, int components, TextureEncoding encoding)
+{
+    int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+    size_t blockBytes = encoding == TEXTURE_BC3 ? 16 : 8;
+    TextureLevel compressed;
+    compressed.width = level.width;
+    compressed.height = level.height;
+    compressed.data.resize(static_cast<size_t>(blocksX) * blocksY * blockBytes);
+
+    unsigned char texels[16][4], values[16];
+    unsigned char* out = compressed.data.data();
+    for (int by = 0; by < blocksY; by++)
+        for (int bx = 0; bx < blocksX; bx++, out += blockBytes)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                int x = std::min(bx * 4 + i % 4, level.width - 1), y = std::min(by * 4 + i / 4, level.height - 1);
+                const unsigned char* texel = &level.data[(static_cast<size_t>(y) * level.width + x) * components];
+                for (int c = 0; c < 4; c++)
+                    texels[i][c] = components == 1 ? texel[0] : c < 3 ? texel[c] : components == 4 ? texel[3] : 255;
+                values[i] = texels[i][components == 1 ? 0 : 3];
+            }
+            if (encoding == TEXTURE_BC4)
+                EncodeBC4Block(values, out);
+            else if (encoding == TEXTURE_BC3)
+            {
+                EncodeBC4Block(values, out);
+                EncodeBC1Block(texels, out + 8);
+            }
+            else
+                EncodeBC1Block(texels, out);
+        }
+    return compressed;
+}
+
+// the encoding for an image: BC4 for one channel (core since GL 3.0), otherwise BC1, or BC3 if any texel isn't
+// opaque, when the GPU has S3TC; uncompressed otherwise
+inline TextureEncoding ChooseTextureEncoding(const unsigned char* pixels, size_t texelCount, int components, bool s3tc)
+{
+    if (components == 1)
+        return TEXTURE_BC4;
+    if (!s3tc)
+        return TEXTURE_RAW;
+    if (components == 4)
+        for (size_t i = 0; i < texelCount; i++)
+            if (pixels[i * 4 + 3] != 255)
+                return TEXTURE_BC3;
+    return TEXTURE_BC1;
+}
+
+// builds and encodes the mip chain of an 8-bit image with 1 to 4 channels (grey and alpha is expanded to RGBA).
+// color tells whether the texels are sRGB colors, see BuildMipChain; s3tc whether the GPU can sample S3TC.
+inline TextureLevels ProcessTexture(const unsigned char* pixels, int width, int height, int components, bool color, bool s3tc)
+{
+    TextureLevels texture;
+    vector<unsigned char> expanded;
+    if (components == 2)
+    {
+        expanded.resize(static_cast<size_t>(width) * height * 4);
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+        {
+            expanded[i * 4] = expanded[i * 4 + 1] = expanded[i * 4 + 2] = pixels[i * 2];
+            expanded[i * 4 + 3] = pixels[i * 2 + 1];
+        }
+        pixels = expanded.data();
+        components = 4;
+    }
+    texture.components = components;
+    texture.encoding = ChooseTextureEncoding(pixels, static_cast<size_t>(width) * height, components, s3tc);
+    texture.levels = BuildMipChain(pixels, width, height, components, color);
+    if (texture.Compressed())
+        for (TextureLevel& level : texture.levels)
+            level = CompressLevel(level, components, texture.encoding);
+    return texture;
+}
+
+// whether the current GL context can sample S3TC (BC1 to BC3) textures. Must run on the GL context thread.
+inline bool SupportsS3tc()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            return true;
+    }
+    return false;
+}
+#endif
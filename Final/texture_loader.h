@@ -0,0 +1,210 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include "job_system.h"
+#include "stb_image.h"
+#include "texture_cache.h"
+#include "texture_compressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// a texture ready to be uploaded to the GPU: its whole mip chain, processed from the image file or read from the
+// texture cache
+struct PreparedTexture {
+    TextureLevels texture;
+    int width = 0;
+    int height = 0;
+    bool fromCache = false;
+    double prepareMilliseconds = 0.0;
+};
+
+// loads an image file's mip chain from the texture cache next to it, or decodes it with stb_image and processes it
+// (see ProcessTexture), writing the cache for next time. color and s3tc are as for ProcessTexture.
+// Touches no GL state, so it is safe to call from any thread.
+inline PreparedTexture PrepareTexture(const string& filename, bool color, bool s3tc)
+{
+    auto start = chrono::steady_clock::now();
+    PreparedTexture prepared;
+    TextureCacheKey cacheKey;
+    bool cacheable = TextureCacheKeyFor(filename, color, s3tc, cacheKey);
+    prepared.fromCache = cacheable && ReadTextureCache(cacheKey, prepared.texture);
+    if (!prepared.fromCache)
+    {
+        int width, height, nrComponents;
+        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+        if (data)
+        {
+            prepared.texture = ProcessTexture(data, width, height, nrComponents, color, s3tc);
+            stbi_image_free(data);
+            if (cacheable && !WriteTextureCache(cacheKey, prepared.texture))
+                cout << "WARNING::TEXTURE_CACHE:: could not write cache for " << filename << endl;
+        }
+    }
+    if (!prepared.texture.levels.empty())
+    {
+        prepared.width = prepared.texture.levels[0].width;
+        prepared.height = prepared.texture.levels[0].height;
+    }
+    prepared.prepareMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return prepared;
+}
+
+// uploads every mip level of a prepared texture into the given texture name and frees the texel data. Must run on
+// the GL context thread.
+inline bool UploadTexture(unsigned int textureID, PreparedTexture& prepared)
+{
+    TextureLevels& texture = prepared.texture;
+    if (texture.levels.empty())
+        return false;
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    // uncompressed rows are tightly packed, which with RGB or small levels breaks the default 4 byte alignment
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < texture.levels.size(); i++)
+    {
+        const TextureLevel& level = texture.levels[i];
+        GLint mip = static_cast<GLint>(i);
+        if (texture.Compressed())
+            glCompressedTexImage2D(GL_TEXTURE_2D, mip, texture.InternalFormat(), level.width, level.height, 0,
+                                   static_cast<GLsizei>(level.data.size()), level.data.data());
+        else
+            glTexImage2D(GL_TEXTURE_2D, mip, texture.InternalFormat(), level.width, level.height, 0, texture.PixelFormat(),
+                         GL_UNSIGNED_BYTE, level.data.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels.size()) - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    texture.levels.clear();
+    texture.levels.shrink_to_fit();
+    return true;
+}
+
+// one line about a loaded texture
+inline void ReportTexture(const string& filename, const PreparedTexture& prepared, size_t bytes, double uploadMilliseconds)
+{
+    cout << "TEXTURE::LOAD " << filename << " " << prepared.width << "x" << prepared.height << " "
+         << prepared.texture.EncodingName() << " " << bytes << " bytes, " << (prepared.fromCache ? "cached" : "processed")
+         << " in " << prepared.prepareMilliseconds << " ms, upload " << uploadMilliseconds << " ms" << endl;
+}
+
+// batches texture loads so that decoding and processing run in parallel. Queue hands out the final texture name
+// right away, so meshes can refer to it immediately; until the texture is loaded it holds a single placeholder texel.
+// Flush then prepares every queued texture (see PrepareTexture) in parallel on the JobSystem and uploads them all on
+// the calling thread, which must own the GL context. Streaming splits Flush up: Prepare can run on any thread, and
+// UploadNext uploads one texture at a time on the GL thread, as its time budget allows.
+class TextureLoader
+{
+public:
+    // reserves a texture name for the image file; its contents are filled in by the next Flush. color tells
+    // whether the texels are sRGB colors, see BuildMipChain. Must run on the GL context thread.
+    unsigned int Queue(const string& filename, bool color)
+    {
+        if (pending.empty() && uploaded == 0)
+            s3tc = SupportsS3tc();
+        PendingTexture texture;
+        glGenTextures(1, &texture.id);
+        texture.filename = filename;
+        texture.color = color;
+        uploadPlaceholder(texture.id, color);
+        pending.push_back(texture);
+        return texture.id;
+    }
+
+    // textures queued and not uploaded yet
+    size_t Pending() const
+    {
+        return pending.size() - uploaded;
+    }
+
+    // prepares the queued textures in parallel, one job each on the JobSystem; the calling thread helps out. Touches
+    // no GL state, so it is safe to call from any thread, as long as nothing queues or uploads meanwhile.
+    void Prepare()
+    {
+        auto start = chrono::steady_clock::now();
+        size_t first = images.size();
+        images.resize(pending.size());
+        JobSystem& jobs = JobSystem::Instance();
+        jobs.ParallelFor(pending.size() - first, 1, [&](size_t begin, size_t end) {
+            for (size_t i = first + begin; i < first + end; i++)
+                images[i] = PrepareTexture(pending[i].filename, pending[i].color, s3tc);
+        });
+        prepareMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        prepareThreads = std::max(prepareThreads, std::min<unsigned int>(jobs.Threads(), static_cast<unsigned int>(pending.size() - first)));
+    }
+
+    // uploads the next prepared texture; returns false once there is none left. Must run on the GL context thread.
+    bool UploadNext()
+    {
+        if (uploaded == images.size())
+            return false;
+        size_t i = uploaded++;
+        auto start = chrono::steady_clock::now();
+        size_t bytes = images[i].texture.Bytes();
+        if (UploadTexture(pending[i].id, images[i]))
+        {
+            double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            ReportTexture(pending[i].filename, images[i], bytes, milliseconds);
+            uploadMilliseconds += milliseconds;
+            uploadedBytes += bytes;
+            cached += images[i].fromCache ? 1 : 0;
+        }
+        else
+            cout << "Texture failed to load at path: " << pending[i].filename << endl;
+
+        if (uploaded == pending.size())
+        {
+            cout << "TEXTURE::LOAD " << pending.size() << " textures (" << cached << " cached, " << uploadedBytes << " bytes): prepare "
+                 << prepareMilliseconds << " ms on " << prepareThreads << " threads, upload " << uploadMilliseconds << " ms" << endl;
+            *this = TextureLoader();
+        }
+        return true;
+    }
+
+    // prepares all queued textures in parallel and uploads them, reporting how long each one took.
+    void Flush()
+    {
+        if (Pending() == 0)
+            return;
+        Prepare();
+        while (UploadNext())
+            ;
+    }
+
+private:
+    struct PendingTexture {
+        unsigned int id;
+        string filename;
+        bool color;
+    };
+    vector<PendingTexture> pending;
+    vector<PreparedTexture> images; // of the pending textures prepared so far
+    size_t uploaded = 0;            // of the prepared textures
+    bool s3tc = false;
+    // totals reported once everything is uploaded
+    double prepareMilliseconds = 0.0, uploadMilliseconds = 0.0;
+    unsigned int prepareThreads = 0;
+    size_t uploadedBytes = 0, cached = 0;
+
+    // a texel to show until the texture is loaded: mid grey for colors, a flat normal for data
+    static void uploadPlaceholder(unsigned int textureID, bool color)
+    {
+        const unsigned char texel[4] = { 128, 128, static_cast<unsigned char>(color ? 128 : 255), 255 };
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+};
+#endif
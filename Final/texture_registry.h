@@ -0,0 +1,116 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include "texture_loader.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+using namespace std;
+
+// the one place textures are loaded through, shared by all models. Textures are keyed on their resolved absolute
+// path plus load flags, so a file referenced by any number of meshes or models is decoded and uploaded only once.
+// Every Acquire adds a reference and must be paired with a Release; the GL texture is deleted with the last one.
+class TextureRegistry
+{
+public:
+    static TextureRegistry& Instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // returns the texture for the image file, adding a reference. A texture that isn't registered yet is queued
+    // on the loader if one is given (its name is valid right away, its contents after the loader is flushed),
+    // otherwise it is loaded immediately. color tells whether the texels are sRGB colors rather than data like
+    // normals, which decides how the mips are filtered (see BuildMipChain).
+    unsigned int Acquire(const string& filename, bool gamma, TextureLoader* loader = nullptr, bool color = true)
+    {
+        string key = makeKey(filename, gamma, color);
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            it->second.refCount++;
+            return it->second.id;
+        }
+
+        unsigned int textureID;
+        if (loader)
+            textureID = loader->Queue(filename, color);
+        else
+        {
+            glGenTextures(1, &textureID);
+            PreparedTexture prepared = PrepareTexture(filename, color, SupportsS3tc());
+            size_t bytes = prepared.texture.Bytes();
+            auto uploadStart = std::chrono::steady_clock::now();
+            if (UploadTexture(textureID, prepared))
+                ReportTexture(filename, prepared, bytes, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count());
+            else
+                std::cout << "Texture failed to load at path: " << filename << std::endl;
+        }
+        entries.emplace(key, Entry{ textureID, 1 });
+        keys.emplace(textureID, key);
+        return textureID;
+    }
+
+    // drops a reference taken by Acquire, deleting the texture once nothing refers to it anymore
+    void Release(unsigned int textureID)
+    {
+        auto key = keys.find(textureID);
+        if (key == keys.end())
+            return;
+        auto it = entries.find(key->second);
+        if (--it->second.refCount == 0)
+        {
+            glDeleteTextures(1, &textureID);
+            entries.erase(it);
+            keys.erase(key);
+        }
+    }
+
+    // number of distinct textures currently alive
+    size_t UniqueCount() const
+    {
+        return entries.size();
+    }
+
+    // number of outstanding references to those textures
+    size_t ReferenceCount() const
+    {
+        size_t count = 0;
+        for (const auto& entry : entries)
+            count += entry.second.refCount;
+        return count;
+    }
+
+private:
+    struct Entry {
+        unsigned int id;
+        unsigned int refCount;
+    };
+    unordered_map<string, Entry> entries;     // by key, see makeKey
+    unordered_map<unsigned int, string> keys; // key of every registered texture name, for Release
+
+    TextureRegistry() = default;
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    // the same file reached through different relative paths must map to the same entry
+    static string makeKey(const string& filename, bool gamma, bool color)
+    {
+        std::error_code ec;
+        std::filesystem::path resolved = std::filesystem::absolute(filename, ec);
+        if (!ec)
+            resolved = std::filesystem::weakly_canonical(resolved, ec);
+        string key = ec ? filename : resolved.generic_string();
+        key += gamma ? "|srgb" : "|linear";
+        key += color ? "|color" : "|data";
+        return key;
+    }
+};
+#endif
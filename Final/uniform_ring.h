@@ -0,0 +1,220 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_extensions.h"
+#include "render_stats.h"
+#include "shader_m.h"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// the uniform blocks of 1.model_loading.vs, laid out as std140 lays them out
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+};
+struct DrawUniforms {
+    glm::mat4 model;          // ignored when drawing instanced; each instance brings its own
+    glm::vec4 positionOffset; // xyz: maps the stored positions back into object space, see PositionQuantization
+    glm::vec4 positionScale;
+    GLint instanced;
+    GLint padding[3];
+};
+static_assert(sizeof(FrameUniforms) == 192, "FrameUniforms must match the std140 layout of the shader block");
+static_assert(sizeof(DrawUniforms) == 112, "DrawUniforms must match the std140 layout of the shader block");
+
+// the binding points the blocks are read from
+const GLuint FRAME_UNIFORM_BINDING = 0;
+const GLuint DRAW_UNIFORM_BINDING = 1;
+const GLuint UNIFORM_RING_BINDINGS = 2;
+
+// points the shader's uniform blocks at their binding points; blocks the shader doesn't declare are skipped
+inline void BindUniformBlocks(const Shader& shader)
+{
+    const char* names[UNIFORM_RING_BINDINGS] = { "FrameUniforms", "DrawUniforms" };
+    for (GLuint binding = 0; binding < UNIFORM_RING_BINDINGS; binding++)
+    {
+        GLuint index = glGetUniformBlockIndex(shader.ID, names[binding]);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, index, binding);
+    }
+}
+
+// the per-frame and per-draw uniform blocks of every frame, streamed through one uniform buffer: each block is
+// copied into the next free part of the buffer and bound there with glBindBufferRange, instead of setting its
+// uniforms one glUniform* call at a time.
+// With buffer storage (see LoadGLExtensions) the buffer stays mapped and is split into UNIFORM_RING_FRAMES parts,
+// one per frame in flight; a fence per part tells when the GPU has finished reading it, so the CPU only ever waits
+// if it gets that many frames ahead. Without, the buffer is orphaned every frame and the blocks written with
+// glBufferSubData.
+// A frame that runs out of room waits for the GPU (or orphans again) and starts over at the beginning of its part;
+// the next frame then gets twice the room.
+const unsigned int UNIFORM_RING_FRAMES = 3;
+
+class UniformRing
+{
+public:
+    static UniformRing& Instance()
+    {
+        static UniformRing instance;
+        return instance;
+    }
+
+    // moves on to the next part of the buffer, waiting for the GPU to finish with it if needed. Creates the buffer
+    // on first use. Must run on the GL context thread, like everything here.
+    void BeginFrame()
+    {
+        if (buffer == 0 || overflowed)
+            create(overflowed ? frameBytes * 2 : frameBytes);
+        overflowed = false;
+        offset = 0;
+        if (!mapped)
+        {
+            // orphan: the driver hands out fresh storage while the GPU still reads the last frame's
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+            return;
+        }
+        frame = (frame + 1) % UNIFORM_RING_FRAMES;
+        waitFor(frame);
+    }
+
+    // marks the end of the frame's uniform data, so the next frame to write the same part waits for the GPU
+    void EndFrame()
+    {
+        if (mapped)
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copies a uniform block into the ring and binds it to the binding point for the draws that follow
+    template <class T>
+    void Bind(GLuint binding, const T& block)
+    {
+        bind(binding, &block, sizeof(T));
+        if (binding < UNIFORM_RING_BINDINGS)
+            remember(binding, &block, sizeof(T));
+    }
+
+    // frees the buffer; call before the context goes away. The next BeginFrame creates it again.
+    void Release()
+    {
+        for (unsigned int i = 0; i < UNIFORM_RING_FRAMES; i++)
+            waitFor(i);
+        if (mapped)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            mapped = nullptr;
+        }
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+private:
+    GLuint buffer = 0;
+    unsigned char* mapped = nullptr; // the persistent mapping of the whole buffer, null when orphaning
+    GLsizeiptr frameBytes = 64 * 1024;
+    GLsizeiptr alignment = 256;      // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    unsigned int frame = 0;          // the part written this frame
+    GLsizeiptr offset = 0;           // the next free byte in it
+    GLsync fences[UNIFORM_RING_FRAMES] = {};
+    bool overflowed = false;
+    // the last block bound to each binding point, written again when a full frame starts over
+    vector<unsigned char> bound[UNIFORM_RING_BINDINGS];
+
+    UniformRing() = default;
+
+    void create(GLsizeiptr bytesPerFrame)
+    {
+        Release();
+        GLint offsetAlignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        alignment = offsetAlignment > 0 ? offsetAlignment : 256;
+        frameBytes = bytesPerFrame;
+        frame = 0;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (glExtensions.persistentMapping)
+        {
+            // coherent, so writes become visible to the GPU without flushing them
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glExtensions.bufferStorage(GL_UNIFORM_BUFFER, frameBytes * UNIFORM_RING_FRAMES, nullptr, flags);
+            mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, frameBytes * UNIFORM_RING_FRAMES, flags));
+            if (!mapped)
+            {
+                // the storage is immutable now, so orphaning needs a buffer of its own
+                cout << "WARNING::UNIFORM_RING:: could not map the buffer persistently, orphaning instead" << endl;
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            }
+        }
+        if (!mapped)
+            glBufferData(GL_UNIFORM_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+        cout << "UNIFORM_RING::CREATE " << (mapped ? "persistent, " : "orphaning, ") << frameBytes << " bytes per frame" << endl;
+    }
+
+    void waitFor(unsigned int part)
+    {
+        if (!fences[part])
+            return;
+        // flush once, so the fence is sure to be signaled eventually, then wait as long as it takes
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fences[part], flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+            flags = 0;
+        glDeleteSync(fences[part]);
+        fences[part] = nullptr;
+    }
+
+    void bind(GLuint binding, const void* data, GLsizeiptr size)
+    {
+        GLsizeiptr start = alignUp(offset);
+        if (start + size > frameBytes)
+        {
+            startOver();
+            start = alignUp(offset);
+        }
+        GLsizeiptr position = (mapped ? frame * frameBytes : 0) + start;
+        if (mapped)
+            memcpy(mapped + position, data, size);
+        else
+            glBufferSubData(GL_UNIFORM_BUFFER, position, size, data);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, position, size);
+        offset = start + size;
+        renderStats.uniformBlocks++;
+    }
+
+    GLsizeiptr alignUp(GLsizeiptr position) const
+    {
+        return (position + alignment - 1) / alignment * alignment;
+    }
+
+    void remember(GLuint binding, const void* data, GLsizeiptr size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        bound[binding].assign(bytes, bytes + size);
+    }
+
+    // the frame's part is full: once the GPU is done with it (or with fresh storage), rewrite the blocks still bound
+    void startOver()
+    {
+        overflowed = true;
+        if (mapped)
+            glFinish();
+        else
+            glBufferData(GL_UNIFORM_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+        offset = 0;
+        for (GLuint binding = 0; binding < UNIFORM_RING_BINDINGS; binding++)
+            if (!bound[binding].empty())
+                bind(binding, bound[binding].data(), static_cast<GLsizeiptr>(bound[binding].size()));
+    }
+};
+#endif
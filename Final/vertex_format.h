@@ -0,0 +1,176 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+#define MAX_BONE_INFLUENCE 4
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+    //bone indexes which will influence this vertex
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    //weights from each bone
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// how a mesh's vertices are laid out in its GPU vertex buffer
+enum VertexFormat {
+    // the Vertex struct as is: full floats for everything plus the bone influences, 88 bytes
+    VERTEX_FORMAT_FULL,
+    // PackedVertex: quantized positions, normals and tangents and half-float texture coordinates, 20 bytes
+    VERTEX_FORMAT_PACKED
+};
+
+// the quantized vertex layout. Positions are 16-bit unsigned normalized values relative to the mesh bounds
+// and are turned back into object space by the vertex shader (positionOffset + aPos * positionScale).
+// Normals and tangents are signed normalized 10_10_10_2; the 2-bit w of the tangent holds the bitangent's
+// handedness, so the bitangent itself isn't stored: it is cross(normal, tangent.xyz) * tangent.w.
+// Bone influences are not part of this layout, meshes that use them stay in VERTEX_FORMAT_FULL.
+struct PackedVertex {
+    uint16_t Position[4]; // xyz, w is padding to keep the next attributes 4-byte aligned
+    uint32_t Normal;
+    uint32_t Tangent;
+    uint32_t TexCoords;   // two half floats
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must stay tightly packed");
+
+// the transform that maps unsigned normalized positions in [0, 1] back into the mesh's bounds
+struct PositionQuantization {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// computes the position quantization covering the given bounds
+inline PositionQuantization QuantizationForBounds(glm::vec3 minimum, glm::vec3 maximum)
+{
+    PositionQuantization quantization;
+    quantization.offset = minimum;
+    quantization.scale = maximum - minimum;
+    // a flat mesh has no extent along some axis; any non-zero scale maps it back exactly
+    for (int i = 0; i < 3; i++)
+        if (quantization.scale[i] <= 0.0f)
+            quantization.scale[i] = 1.0f;
+    return quantization;
+}
+
+// computes the position quantization covering the given vertex positions
+inline PositionQuantization QuantizationForBounds(const vector<Vertex>& vertices)
+{
+    if (vertices.empty())
+        return PositionQuantization();
+
+    glm::vec3 minimum = vertices[0].Position;
+    glm::vec3 maximum = vertices[0].Position;
+    for (const Vertex& vertex : vertices)
+    {
+        minimum = glm::min(minimum, vertex.Position);
+        maximum = glm::max(maximum, vertex.Position);
+    }
+    return QuantizationForBounds(minimum, maximum);
+}
+
+// packs a full vertex into the quantized layout
+inline PackedVertex PackVertex(const Vertex& vertex, const PositionQuantization& quantization)
+{
+    PackedVertex packed;
+    glm::vec3 position = glm::clamp((vertex.Position - quantization.offset) / quantization.scale, 0.0f, 1.0f);
+    for (int i = 0; i < 3; i++)
+        packed.Position[i] = static_cast<uint16_t>(position[i] * 65535.0f + 0.5f);
+    packed.Position[3] = 0;
+
+    float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+    packed.Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+    packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(vertex.Tangent, handedness));
+    packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+    return packed;
+}
+
+// sets up the attribute pointers for a buffer of Vertex
+inline void SetupFullVertexAttributes()
+{
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    // ids
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+
+    // weights
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+}
+
+// attribute location of the per-instance model matrix. A mat4 takes four locations, one per column (7 to 10),
+// which come after everything the vertex formats use.
+const GLuint INSTANCE_MATRIX_LOCATION = 7;
+
+// points the instance matrix attribute of the bound VAO at a buffer of glm::mat4, starting at firstInstance and
+// advancing once per instance
+inline void EnableInstanceAttributes(unsigned int buffer, size_t firstInstance)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint column = 0; column < 4; column++)
+    {
+        GLuint location = INSTANCE_MATRIX_LOCATION + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(firstInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// turns the instance matrix attribute of the bound VAO off again; VAOs are shared by all meshes of a format, and
+// the ones drawn without instancing must not see it
+inline void DisableInstanceAttributes()
+{
+    for (GLuint column = 0; column < 4; column++)
+        glDisableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+}
+
+// sets up the attribute pointers for a buffer of PackedVertex, using the same locations as the full layout
+inline void SetupPackedVertexAttributes()
+{
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    // vertex tangent, with the bitangent sign in w
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+}
+#endif